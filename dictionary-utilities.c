@@ -0,0 +1,126 @@
+// Utilities for training compression dictionaries
+// PackLab - CS213 - Northwestern University
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dictionary-utilities.h"
+
+// Work description for one histogram thread
+typedef struct {
+  const uint8_t* data;
+  size_t data_len;
+  size_t start;
+  size_t end;
+  uint64_t savings[256];
+} savings_job_t;
+
+static void* savings_thread(void* arg) {
+  savings_job_t* job = arg;
+  collect_run_savings(job->data, job->data_len, job->start, job->end, job->savings);
+  return NULL;
+}
+
+// --- public functions ---
+
+uint64_t run_savings(uint8_t value, size_t run_len) {
+  uint64_t literal_cost = (value == ESCAPE_BYTE) ? 2 : 1;
+
+  // Full tokens cost two bytes each, a leftover partial run is encoded
+  // whichever way is cheaper
+  uint64_t full_tokens = run_len / MAX_TOKEN_REPEAT;
+  uint64_t remainder_cost = (run_len % MAX_TOKEN_REPEAT) * literal_cost;
+  if (remainder_cost > 2) {
+    remainder_cost = 2;
+  }
+
+  return (run_len * literal_cost) - (2 * full_tokens + remainder_cost);
+}
+
+void collect_run_savings(const uint8_t* data, size_t data_len,
+                         size_t start, size_t end, uint64_t savings[256]) {
+  if (end > data_len) {
+    end = data_len;
+  }
+
+  // Skip the tail of a run that began before this range
+  size_t i = start;
+  while (i > 0 && i < end && data[i] == data[i - 1]) {
+    i++;
+  }
+
+  while (i < end) {
+    uint8_t value = data[i];
+    size_t run_end = i + 1;
+    while (run_end < data_len && data[run_end] == value) {
+      run_end++;
+    }
+    savings[value] += run_savings(value, run_end - i);
+    i = run_end;
+  }
+}
+
+void collect_run_savings_parallel(const uint8_t* data, size_t data_len,
+                                  size_t thread_count, uint64_t savings[256]) {
+  // Not worth starting threads for small inputs
+  const size_t min_chunk_len = 1 << 20;
+  if (thread_count > data_len / min_chunk_len) {
+    thread_count = data_len / min_chunk_len;
+  }
+  if (thread_count <= 1) {
+    collect_run_savings(data, data_len, 0, data_len, savings);
+    return;
+  }
+
+  savings_job_t* jobs = malloc_and_check(thread_count * sizeof(savings_job_t));
+  pthread_t* threads = malloc_and_check(thread_count * sizeof(pthread_t));
+  size_t chunk_len = data_len / thread_count;
+
+  for (size_t t = 0; t < thread_count; t++) {
+    jobs[t].data = data;
+    jobs[t].data_len = data_len;
+    jobs[t].start = t * chunk_len;
+    jobs[t].end = (t == thread_count - 1) ? data_len : (t + 1) * chunk_len;
+    memset(jobs[t].savings, 0, sizeof(jobs[t].savings));
+    if (pthread_create(&threads[t], NULL, savings_thread, &jobs[t]) != 0) {
+      error_and_exit("ERROR: could not create thread\n");
+    }
+  }
+
+  for (size_t t = 0; t < thread_count; t++) {
+    pthread_join(threads[t], NULL);
+    for (int value = 0; value < 256; value++) {
+      savings[value] += jobs[t].savings[value];
+    }
+  }
+
+  free(threads);
+  free(jobs);
+}
+
+uint64_t choose_dictionary(const uint64_t savings[256], uint8_t* dictionary_data) {
+  // Savings of each byte value are independent of the others, so the best
+  // dictionary is just the top DICTIONARY_LENGTH values
+  bool chosen[256] = {false};
+  uint64_t total = 0;
+
+  for (int slot = 0; slot < DICTIONARY_LENGTH; slot++) {
+    int best = -1;
+    for (int value = 0; value < 256; value++) {
+      if (!chosen[value] && (best < 0 || savings[value] > savings[best])) {
+        best = value;
+      }
+    }
+    chosen[best] = true;
+    dictionary_data[slot] = best;
+    total += savings[best];
+  }
+
+  return total;
+}
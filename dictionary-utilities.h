@@ -0,0 +1,35 @@
+// Utilities for training compression dictionaries
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "unpack-utilities.h"
+
+// Definitions
+// Longest run a single 0x07 0xXY token can encode (X is four bits, nonzero)
+#define MAX_TOKEN_REPEAT 15
+
+// Returns the number of bytes saved by encoding a run of `run_len` copies of
+// `value` with dictionary tokens rather than literal bytes
+// Literal 0x07 bytes cost two bytes each, since they must be escaped
+uint64_t run_savings(uint8_t value, size_t run_len);
+
+// Adds the savings for every run starting in [start, end) of data to
+// savings[value], where `value` is the run's byte
+// Runs that start in the range but extend past `end` are counted in full,
+// and a run continuing from before `start` is left to whoever counts its start
+void collect_run_savings(const uint8_t* data, size_t data_len,
+                         size_t start, size_t end, uint64_t savings[256]);
+
+// Same as collect_run_savings() over all of data, split across
+// `thread_count` threads
+void collect_run_savings_parallel(const uint8_t* data, size_t data_len,
+                                  size_t thread_count, uint64_t savings[256]);
+
+// Picks the DICTIONARY_LENGTH byte values with the largest savings and writes
+// them into dictionary_data
+// Returns the total number of bytes saved by that dictionary
+uint64_t choose_dictionary(const uint64_t savings[256], uint8_t* dictionary_data);
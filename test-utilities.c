@@ -1,12 +1,20 @@
 // Application to test unpack utilities
 // PackLab - CS213 - Northwestern University
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "dictionary-utilities.h"
+#include "unpack-cache.h"
+#include "unpack-keystream.h"
 #include "unpack-utilities.h"
 
 
@@ -207,6 +215,388 @@ return 0;
 }
 
 
+int test_crc32c(void) {
+  // Standard CRC32C check value
+  uint8_t check_data[] = "123456789";
+  if (calculate_crc32c(check_data, 9) != 0xE3069283) {
+    return 1;
+  }
+  if (extend_crc32c(calculate_crc32c(check_data, 4), &(check_data[4]), 5) != 0xE3069283 ||
+      extend_crc32c(0, check_data, 9) != 0xE3069283) {
+    return 1;
+  }
+
+  // A header with the CRC32C flag carries a 4-byte big-endian checksum
+  uint8_t crcHeader[] = {0x02, 0x13, 0x01, 0x30, 0xE3, 0x06, 0x92, 0x83};
+  packlab_config_t config1 = {0};
+  parse_header(crcHeader, sizeof(crcHeader), &config1);
+  if (!(config1.is_valid && config1.is_checksummed && config1.is_crc32c) ||
+      config1.crc32c_value != 0xE3069283 || config1.header_len != 8) {
+    return 2;
+  }
+
+  // Too short to hold the 4-byte checksum
+  packlab_config_t config2 = {0};
+  parse_header(crcHeader, 6, &config2);
+  if (config2.is_valid) {
+    return 2;
+  }
+
+  // The fused decrypt must match separate decrypt and CRC passes, across
+  // block boundaries and with an odd length
+  size_t len = 10001;
+  uint8_t* input = malloc_and_check(len);
+  uint8_t* expected = malloc_and_check(len);
+  uint8_t* output = malloc_and_check(len);
+  for (size_t i = 0; i < len; i++) {
+    input[i] = (uint8_t)(i * 31 + 7);
+  }
+  decrypt_data(input, len, expected, len, 0x1337);
+  uint32_t crc = decrypt_data_crc32c(input, len, output, len, 0x1337);
+  int result = 0;
+  if (crc != calculate_crc32c(input, len) || memcmp(expected, output, len) != 0) {
+    result = 3;
+  }
+  free(input);
+  free(expected);
+  free(output);
+
+  return result;
+}
+
+int test_train_dictionary(void) {
+  // Runs shorter than three bytes save nothing, escaped 0x07 literals save more
+  if (run_savings(0x41, 2) != 0 || run_savings(0x41, 3) != 1 ||
+      run_savings(0x41, 15) != 13 || run_savings(0x41, 16) != 13 ||
+      run_savings(ESCAPE_BYTE, 2) != 2) {
+    return 1;
+  }
+
+  // Splitting the data must not double count or lose runs at chunk boundaries
+  uint8_t data[] = {0x41, 0x41, 0x41, 0x41, 0x42, 0x42, 0x42, 0x07, 0x07, 0x43};
+  uint64_t whole[256] = {0};
+  uint64_t split[256] = {0};
+  collect_run_savings(data, sizeof(data), 0, sizeof(data), whole);
+  collect_run_savings(data, sizeof(data), 0, 2, split);
+  collect_run_savings(data, sizeof(data), 2, 5, split);
+  collect_run_savings(data, sizeof(data), 5, sizeof(data), split);
+  if (memcmp(whole, split, sizeof(whole)) != 0 ||
+      whole[0x41] != 2 || whole[0x42] != 1 || whole[0x07] != 2) {
+    return 2;
+  }
+
+  // The best values come first
+  uint8_t dictionary[DICTIONARY_LENGTH];
+  if (choose_dictionary(whole, dictionary) != 5 || dictionary[0] != 0x07 || dictionary[1] != 0x41) {
+    return 3;
+  }
+
+  return 0;
+}
+
+int test_read_pack_header(void) {
+  // Only the header is read, but the payload length comes from the file size
+  const char* filename = "test-read-pack-header.pack";
+  uint8_t packed[] = {0x02, 0x13, 0x01, 0x20, 0x00, 0x06, 0x01, 0x02, 0x03};
+  FILE* fd = fopen(filename, "w");
+  if (fd == NULL || fwrite(packed, 1, sizeof(packed), fd) != sizeof(packed)) {
+    return 1;
+  }
+  fclose(fd);
+
+  packlab_config_t config = {0};
+  size_t payload_len = 0;
+  bool read_ok = read_pack_header(filename, &config, &payload_len);
+  remove(filename);
+  if (!read_ok || !config.is_valid || !config.is_checksummed ||
+      config.header_len != 6 || payload_len != 3 || config.checksum_value != 0x0006) {
+    return 2;
+  }
+
+  if (read_pack_header("test-read-pack-header.missing", &config, &payload_len)) {
+    return 3;
+  }
+
+  // A FIFO with no writer must be refused, not waited on
+  const char* fifo_name = "test-read-pack-header.fifo";
+  remove(fifo_name);
+  if (mkfifo(fifo_name, 0600) != 0) {
+    return 4;
+  }
+  read_ok = read_pack_header(fifo_name, &config, &payload_len);
+  remove(fifo_name);
+  if (read_ok) {
+    return 5;
+  }
+
+  return 0;
+}
+
+int test_write_sparse(void) {
+  // Zero pages at the start, middle, and end must all read back as zeros
+  const char* filename = "test-write-sparse.out";
+  size_t len = 5 * 4096 + 100;
+  uint8_t* data = malloc_and_check(len);
+  uint8_t* readback = malloc_and_check(len);
+  memset(data, 0, len);
+  data[2 * 4096 + 7] = 0xAB;
+  data[3 * 4096] = 0xCD;
+
+  int result = 0;
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0 || !write_sparse(fd, data, len)) {
+    result = 1;
+  }
+  close(fd);
+
+  FILE* input_fd = fopen(filename, "r");
+  if (result == 0 && (input_fd == NULL || fread(readback, 1, len, input_fd) != len ||
+                      fgetc(input_fd) != EOF || memcmp(data, readback, len) != 0)) {
+    result = 2;
+  }
+  if (input_fd != NULL) {
+    fclose(input_fd);
+  }
+  remove(filename);
+
+  // Non-regular outputs can't seek, so they get every byte written
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (result == 0 && (null_fd < 0 || !write_sparse(null_fd, data, len))) {
+    result = 3;
+  }
+  if (null_fd >= 0) {
+    close(null_fd);
+  }
+
+  int pipe_fds[2] = {-1, -1};
+  uint8_t small[] = {0x00, 0x00, 0x01, 0x00};
+  uint8_t small_readback[sizeof(small)] = {0xFF};
+  if (result == 0 && (pipe(pipe_fds) != 0 || !write_sparse(pipe_fds[1], small, sizeof(small)) ||
+                      !read_all(pipe_fds[0], small_readback, sizeof(small)) ||
+                      memcmp(small, small_readback, sizeof(small)) != 0)) {
+    result = 4;
+  }
+  if (pipe_fds[0] >= 0) {
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+  }
+
+  free(data);
+  free(readback);
+
+  return result;
+}
+
+int test_decompressed_length(void) {
+  // Runs, an escaped 0x07, a literal, and a lone trailing escape (which
+  // decompress_data() drops)
+  uint8_t input[] = {0x07, 0x70, 0x07, 0x00, 0xF2, 0x07, 0x52, 0x07};
+  uint8_t dictionary[DICTIONARY_LENGTH] = {0};
+  uint8_t output[32];
+
+  size_t expected = decompress_data(input, sizeof(input), output, sizeof(output), dictionary);
+  if (expected != 14 || decompressed_length(input, sizeof(input)) != expected) {
+    return 1;
+  }
+
+  return 0;
+}
+
+int test_lfsr_keystream(void) {
+  // XORing with the keystream must match decrypt_data(), including when the
+  // keystream is produced in pieces
+  uint8_t input[9] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90};
+  uint8_t expected[9];
+  decrypt_data(input, sizeof(input), expected, sizeof(expected), 0xBEEF);
+
+  uint8_t keystream[10];
+  uint16_t state = lfsr_step(0xBEEF);
+  lfsr_keystream(&state, keystream, 4);
+  lfsr_keystream(&state, &(keystream[4]), 6);
+  for (size_t i = 0; i < sizeof(input); i++) {
+    if ((input[i] ^ keystream[i]) != expected[i]) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int test_decrypt_cached(void) {
+  // Must match decrypt_data() for odd lengths and lengths past the cached
+  // prefix, including after the cached keystream was extended by earlier calls
+  // The fused CRC32C variant must also match a separate CRC pass
+  size_t max_len = 2 * KEYSTREAM_CACHE_LENGTH + 3;
+  uint8_t* input = malloc_and_check(max_len);
+  uint8_t* expected = malloc_and_check(max_len);
+  uint8_t* output = malloc_and_check(max_len);
+  for (size_t i = 0; i < max_len; i++) {
+    input[i] = (uint8_t)(i * 7 + 3);
+  }
+
+  size_t lengths[] = {0, 1, 7, 4097, KEYSTREAM_CACHE_LENGTH - 1, KEYSTREAM_CACHE_LENGTH,
+                      KEYSTREAM_CACHE_LENGTH + 1, max_len, 5};
+  uint16_t keys[] = {0xBEEF, 0x1234};
+  keystream_cache_t cache = {0};
+  int result = 0;
+  for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]) && result == 0; k++) {
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+      decrypt_data(input, lengths[i], expected, lengths[i], keys[k]);
+      decrypt_cached(&cache, input, lengths[i], output, keys[k]);
+      if (lengths[i] > 0 && memcmp(output, expected, lengths[i]) != 0) {
+        result = 1 + (int)k;
+        break;
+      }
+      memset(output, 0, lengths[i]);
+      uint32_t crc = decrypt_cached_crc32c(&cache, input, lengths[i], output, keys[k]);
+      if (crc != calculate_crc32c(input, lengths[i]) ||
+          (lengths[i] > 0 && memcmp(output, expected, lengths[i]) != 0)) {
+        result = 4;
+        break;
+      }
+    }
+  }
+
+  // More keys than the cache holds evict entries, which must not change output
+  for (uint16_t key = 0; key < 2 * KEYSTREAM_CACHE_ENTRIES && result == 0; key++) {
+    decrypt_data(input, 4097, expected, 4097, key);
+    decrypt_cached(&cache, input, 4097, output, key);
+    if (memcmp(output, expected, 4097) != 0) {
+      result = 3;
+    }
+  }
+
+  keystream_cache_free(&cache);
+  free(input);
+  free(expected);
+  free(output);
+  return result;
+}
+
+int test_sha256(void) {
+  // Standard SHA-256 test vectors, one and two blocks long
+  uint8_t expected_abc[32] = {0xBA, 0x78, 0x16, 0xBF, 0x8F, 0x01, 0xCF, 0xEA, 0x41, 0x41, 0x40, 0xDE, 0x5D, 0xAE, 0x22, 0x23,
+                              0xB0, 0x03, 0x61, 0xA3, 0x96, 0x17, 0x7A, 0x9C, 0xB4, 0x10, 0xFF, 0x61, 0xF2, 0x00, 0x15, 0xAD};
+  uint8_t expected_long[32] = {0x24, 0x8D, 0x6A, 0x61, 0xD2, 0x06, 0x38, 0xB8, 0xE5, 0xC0, 0x26, 0x93, 0x0C, 0x3E, 0x60, 0x39,
+                               0xA3, 0x3C, 0xE4, 0x59, 0x64, 0xFF, 0x21, 0x67, 0xF6, 0xEC, 0xED, 0xD4, 0x19, 0xDB, 0x06, 0xC1};
+  const char* long_input = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  uint8_t digest[32];
+  sha256_t hash;
+  sha256_init(&hash);
+  sha256_update(&hash, (const uint8_t*)"abc", 3);
+  sha256_final(&hash, digest);
+  if (memcmp(digest, expected_abc, 32) != 0) {
+    return 1;
+  }
+  sha256_init(&hash);
+  sha256_update(&hash, (const uint8_t*)long_input, 20);
+  sha256_update(&hash, (const uint8_t*)&(long_input[20]), strlen(long_input) - 20);
+  sha256_final(&hash, digest);
+  if (memcmp(digest, expected_long, 32) != 0) {
+    return 2;
+  }
+
+  // Many blocks, fed in pieces that don't line up with block boundaries
+  uint8_t expected_million[32] = {0xCD, 0xC7, 0x6E, 0x5C, 0x99, 0x14, 0xFB, 0x92, 0x81, 0xA1, 0xC7, 0xE2, 0x84, 0xD7, 0x3E, 0x67,
+                                  0xF1, 0x80, 0x9A, 0x48, 0xA4, 0x97, 0x20, 0x0E, 0x04, 0x6D, 0x39, 0xCC, 0xC7, 0x11, 0x2C, 0xD0};
+  uint8_t piece[1000];
+  memset(piece, 'a', sizeof(piece));
+  sha256_init(&hash);
+  for (int i = 0; i < 1000; i++) {
+    sha256_update(&hash, piece, sizeof(piece));
+  }
+  sha256_final(&hash, digest);
+  if (memcmp(digest, expected_million, 32) != 0) {
+    return 3;
+  }
+
+  return 0;
+}
+
+int test_cache(void) {
+  // The same pack under a different password needs a different key
+  uint8_t header[] = {0x02, 0x13, 0x01, 0x40};
+  uint8_t payload[] = {0x01, 0x02, 0x03};
+  char key1[CACHE_KEY_LENGTH];
+  char key2[CACHE_KEY_LENGTH];
+  cache_key(header, sizeof(header), payload, sizeof(payload), true, 0x1234, key1);
+  cache_key(header, sizeof(header), payload, sizeof(payload), true, 0x1235, key2);
+  if (strlen(key1) != CACHE_KEY_LENGTH - 1 || strcmp(key1, key2) == 0) {
+    return 1;
+  }
+
+  // Equal packs share a key, while one changed or extra payload byte doesn't
+  char key3[CACHE_KEY_LENGTH];
+  uint8_t longer[] = {0x01, 0x02, 0x03, 0x00};
+  cache_key(header, sizeof(header), payload, sizeof(payload), true, 0x1234, key3);
+  if (strcmp(key1, key3) != 0) {
+    return 2;
+  }
+  cache_key(header, sizeof(header), longer, sizeof(longer), true, 0x1234, key3);
+  if (strcmp(key1, key3) == 0) {
+    return 2;
+  }
+  longer[0] = 0x81;
+  cache_key(header, sizeof(header), longer, 3, true, 0x1234, key3);
+  if (strcmp(key1, key3) == 0) {
+    return 2;
+  }
+
+  // A stored output comes back on the next fetch, and only then
+  // The first unpack writes to /dev/null, which must not leave an empty entry
+  const char* cache_dir = "test-cache-dir";
+  const char* fetched_filename = "test-cache.fetched";
+  int output_fd = open("/dev/null", O_WRONLY);
+  if (output_fd < 0 || !write_sparse(output_fd, payload, sizeof(payload))) {
+    return 3;
+  }
+  close(output_fd);
+
+  int result = 0;
+  if (cache_fetch(cache_dir, key1, fetched_filename)) {
+    result = 3;
+  }
+  cache_store(cache_dir, key1, payload, sizeof(payload), CACHE_DEFAULT_MAX_BYTES);
+  uint8_t readback[8] = {0};
+  FILE* fd = NULL;
+  if (result == 0 && (!cache_fetch(cache_dir, key1, fetched_filename) ||
+                      (fd = fopen(fetched_filename, "r")) == NULL ||
+                      fread(readback, 1, sizeof(readback), fd) != sizeof(payload) ||
+                      memcmp(readback, payload, sizeof(payload)) != 0)) {
+    result = 4;
+  }
+  if (fd != NULL) {
+    fclose(fd);
+  }
+
+  // Entries may hold decrypted data, so only the owner can read them
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", cache_dir, key1);
+  struct stat st;
+  if (result == 0 && (stat(path, &st) != 0 || (st.st_mode & 077) != 0 ||
+                      stat(cache_dir, &st) != 0 || (st.st_mode & 077) != 0)) {
+    result = 6;
+  }
+
+  // Storing past the size limit evicts the least recently used entry
+  struct timespec long_ago[2] = {{.tv_sec = 1}, {.tv_sec = 1}};
+  utimensat(AT_FDCWD, path, long_ago, 0);
+  cache_store(cache_dir, key2, payload, sizeof(payload), 4);
+  if (result == 0 && cache_fetch(cache_dir, key1, fetched_filename)) {
+    result = 5;
+  }
+
+  remove(path);
+  snprintf(path, sizeof(path), "%s/%s", cache_dir, key2);
+  remove(path);
+  snprintf(path, sizeof(path), "%s/.lock", cache_dir);
+  remove(path);
+  remove(cache_dir);
+  remove(fetched_filename);
+
+  return result;
+}
+
 
 int main(void) {
 
@@ -268,6 +658,60 @@ int main(void) {
     }
   }
 
+  result = test_crc32c();
+  if (result != 0) {
+    printf("ERROR: error in test %d of test_crc32c\n", result);
+    return 1;
+  }
+
+  result = test_train_dictionary();
+  if (result != 0) {
+    printf("ERROR: error in test %d of test_train_dictionary\n", result);
+    return 1;
+  }
+
+  result = test_read_pack_header();
+  if (result != 0) {
+    printf("ERROR: error in test %d of test_read_pack_header\n", result);
+    return 1;
+  }
+
+  result = test_write_sparse();
+  if (result != 0) {
+    printf("ERROR: error in test %d of test_write_sparse\n", result);
+    return 1;
+  }
+
+  result = test_decompressed_length();
+  if (result != 0) {
+    printf("ERROR: error in test %d of test_decompressed_length\n", result);
+    return 1;
+  }
+
+  result = test_lfsr_keystream();
+  if (result != 0) {
+    printf("ERROR: error in test %d of test_lfsr_keystream\n", result);
+    return 1;
+  }
+
+  result = test_decrypt_cached();
+  if (result != 0) {
+    printf("ERROR: error in test %d of test_decrypt_cached\n", result);
+    return 1;
+  }
+
+  result = test_sha256();
+  if (result != 0) {
+    printf("ERROR: error in test %d of test_sha256\n", result);
+    return 1;
+  }
+
+  result = test_cache();
+  if (result != 0) {
+    printf("ERROR: error in test %d of test_cache\n", result);
+    return 1;
+  }
+
   printf("All tests passed successfully!\n");
   return 0;
 }
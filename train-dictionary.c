@@ -0,0 +1,91 @@
+// Application to train a compression dictionary from sample files
+// PackLab - CS213 - Northwestern University
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dictionary-utilities.h"
+#include "unpack-utilities.h"
+
+
+int main(int argc, char* argv[]) {
+  // Parse app flags
+  // Optional `-o dictfile` to write the raw 16-byte dictionary for the header
+  char* dictionary_filename = NULL;
+  int first_sample = 1;
+  if (argc >= 3 && strcmp(argv[1], "-o") == 0) {
+    dictionary_filename = argv[2];
+    first_sample = 3;
+  }
+  if (first_sample >= argc) {
+    printf("usage: %s [-o dictfile] samplefile...\n", argv[0]);
+    error_and_exit("\n");
+  }
+
+  long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t thread_count = (cpu_count > 0) ? (size_t)cpu_count : 1;
+
+  // Accumulate run savings across every sample file
+  uint64_t savings[256] = {0};
+  size_t sample_len = 0;
+  for (int i = first_sample; i < argc; i++) {
+    FILE* input_fd = fopen(argv[i], "r");
+    if (input_fd == NULL) {
+      error_and_exit("ERROR: sample file likely does not exist\n");
+    }
+
+    struct stat st;
+    if (fstat(fileno(input_fd), &st) != 0) {
+      error_and_exit("ERROR: sample file likely does not exist\n");
+    }
+    size_t input_len = st.st_size;
+    if (input_len == 0) {
+      fclose(input_fd);
+      continue;
+    }
+
+    uint8_t* input_data = malloc_and_check(input_len);
+    size_t read_len = fread(input_data, sizeof(uint8_t), input_len, input_fd);
+    if (read_len != input_len) {
+      error_and_exit("ERROR: fread failed on sample\n");
+    }
+    fclose(input_fd);
+
+    collect_run_savings_parallel(input_data, input_len, thread_count, savings);
+    sample_len += input_len;
+    free(input_data);
+  }
+
+  // Pick the dictionary
+  uint8_t dictionary_data[DICTIONARY_LENGTH];
+  uint64_t saved = choose_dictionary(savings, dictionary_data);
+
+  printf("dictionary: ");
+  for (int i = 0; i < DICTIONARY_LENGTH; i++) {
+    printf("%02X", dictionary_data[i]);
+  }
+  printf("\n");
+  printf("estimated savings: %lu of %lu sample bytes\n",
+         (unsigned long)saved, (unsigned long)sample_len);
+
+  // Write the dictionary exactly as it is laid out in the header
+  if (dictionary_filename != NULL) {
+    FILE* output_fd = fopen(dictionary_filename, "w");
+    if (output_fd == NULL) {
+      error_and_exit("ERROR: could not open dictionary file\n");
+    }
+    if (fwrite(dictionary_data, sizeof(uint8_t), DICTIONARY_LENGTH, output_fd) != DICTIONARY_LENGTH) {
+      error_and_exit("ERROR: could not write dictionary file\n");
+    }
+    fclose(output_fd);
+  }
+
+  return 0;
+}
@@ -0,0 +1,444 @@
+// Content-addressed cache of unpacked output
+// PackLab - CS213 - Northwestern University
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unpack-cache.h"
+#include "unpack-utilities.h"
+
+// Definitions
+#define CACHE_PATH_LENGTH 4096
+// Leftover temporary files older than this (in seconds) are from crashed unpacks
+#define CACHE_STALE_TEMP_AGE 3600
+
+// One cache file seen while evicting
+typedef struct {
+  char name[CACHE_KEY_LENGTH];
+  struct timespec last_used;
+  uint64_t size;
+} cache_entry_t;
+
+static const uint32_t sha256_constants[64] = {
+  0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+  0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+  0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+  0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+  0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+  0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+  0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+  0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static uint32_t rotate_right(uint32_t value, int count) {
+  return (value >> count) | (value << (32 - count));
+}
+
+// Mixes one 64-byte block into the hash state, one round at a time
+static void sha256_block_portable(uint32_t* state, const uint8_t* block) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) |
+           ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = state[0];
+  uint32_t b = state[1];
+  uint32_t c = state[2];
+  uint32_t d = state[3];
+  uint32_t e = state[4];
+  uint32_t f = state[5];
+  uint32_t g = state[6];
+  uint32_t h = state[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+    uint32_t choice = (e & f) ^ (~e & g);
+    uint32_t temp1 = h + s1 + choice + sha256_constants[i] + w[i];
+    uint32_t s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+    uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t temp2 = s0 + majority;
+    h = g;
+    g = f;
+    f = e;
+    e = d + temp1;
+    d = c;
+    c = b;
+    b = a;
+    a = temp1 + temp2;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+
+static __m128i load_128(const void* data) {
+  __m128i value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static void store_128(void* data, __m128i value) {
+  memcpy(data, &value, sizeof(value));
+}
+
+// Mixes 64-byte blocks into the hash state using the SHA extensions, which
+// run four rounds and four message schedule words per instruction pair
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t* state, const uint8_t* data, size_t block_count) {
+  const __m128i byte_swap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+
+  // The instructions want the state as ABEF and CDGH
+  __m128i dcba = load_128(&(state[0]));
+  __m128i hgfe = load_128(&(state[4]));
+  __m128i cdab = _mm_shuffle_epi32(dcba, 0xB1);
+  __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+  __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+  __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+  for (; block_count > 0; block_count--) {
+    __m128i abef_start = abef;
+    __m128i cdgh_start = cdgh;
+
+    // Message schedule words, four at a time, recycled as the rounds go
+    __m128i words[4];
+    for (int i = 0; i < 4; i++) {
+      words[i] = _mm_shuffle_epi8(load_128(&(data[16 * i])), byte_swap);
+    }
+
+    for (int i = 0; i < 16; i++) {
+      __m128i message = _mm_add_epi32(words[i % 4], load_128(&(sha256_constants[4 * i])));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+      message = _mm_shuffle_epi32(message, 0x0E);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, message);
+
+      // Replace the words just used with the ones twelve rounds later
+      if (i < 12) {
+        __m128i next = _mm_sha256msg1_epu32(words[i % 4], words[(i + 1) % 4]);
+        next = _mm_add_epi32(next, _mm_alignr_epi8(words[(i + 3) % 4], words[(i + 2) % 4], 4));
+        words[i % 4] = _mm_sha256msg2_epu32(next, words[(i + 3) % 4]);
+      }
+    }
+
+    abef = _mm_add_epi32(abef, abef_start);
+    cdgh = _mm_add_epi32(cdgh, cdgh_start);
+    data += 64;
+  }
+
+  __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+  __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+  store_128(&(state[0]), _mm_blend_epi16(feba, dchg, 0xF0));
+  store_128(&(state[4]), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+static void sha256_blocks(uint32_t* state, const uint8_t* data, size_t block_count) {
+  if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+    sha256_blocks_shani(state, data, block_count);
+    return;
+  }
+  for (size_t i = 0; i < block_count; i++) {
+    sha256_block_portable(state, &(data[64 * i]));
+  }
+}
+#else
+static void sha256_blocks(uint32_t* state, const uint8_t* data, size_t block_count) {
+  for (size_t i = 0; i < block_count; i++) {
+    sha256_block_portable(state, &(data[64 * i]));
+  }
+}
+#endif
+
+// Builds the path of a file inside the cache directory
+// Returns false if it doesn't fit
+static bool cache_path(char* path, const char* cache_dir, const char* name) {
+  int len = snprintf(path, CACHE_PATH_LENGTH, "%s/%s", cache_dir, name);
+  return len > 0 && len < CACHE_PATH_LENGTH;
+}
+
+// Copies all of input_fd into output_fd, sharing extents with a reflink
+// when the filesystem supports it
+static bool copy_file(int input_fd, int output_fd, size_t len) {
+  if (ioctl(output_fd, FICLONE, input_fd) == 0) {
+    return true;
+  }
+
+  // copy_file_range() still avoids copying through user space
+  size_t copied = 0;
+  while (copied < len) {
+    ssize_t result = copy_file_range(input_fd, NULL, output_fd, NULL, len - copied, 0);
+    if (result <= 0) {
+      break;
+    }
+    copied += result;
+  }
+  if (copied == len) {
+    return true;
+  }
+
+  // Fall back to reading and writing the rest
+  uint8_t buffer[65536];
+  while (copied < len) {
+    ssize_t read_len = pread(input_fd, buffer, sizeof(buffer), copied);
+    if (read_len <= 0 || !write_all(output_fd, buffer, read_len)) {
+      return false;
+    }
+    copied += read_len;
+  }
+  return true;
+}
+
+static int compare_last_used(const void* first, const void* second) {
+  const cache_entry_t* a = first;
+  const cache_entry_t* b = second;
+  if (a->last_used.tv_sec != b->last_used.tv_sec) {
+    return (a->last_used.tv_sec > b->last_used.tv_sec) - (a->last_used.tv_sec < b->last_used.tv_sec);
+  }
+  return (a->last_used.tv_nsec > b->last_used.tv_nsec) - (a->last_used.tv_nsec < b->last_used.tv_nsec);
+}
+
+// Removes least recently used entries until the cache holds at most max_bytes
+// Only one process evicts at a time; the others skip it rather than wait
+static void cache_evict(const char* cache_dir, uint64_t max_bytes) {
+  char path[CACHE_PATH_LENGTH];
+  if (!cache_path(path, cache_dir, ".lock")) {
+    return;
+  }
+  int lock_fd = open(path, O_RDONLY | O_CREAT, 0600);
+  if (lock_fd < 0) {
+    return;
+  }
+  if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+    close(lock_fd);
+    return;
+  }
+
+  DIR* dir = opendir(cache_dir);
+  if (dir == NULL) {
+    close(lock_fd);
+    return;
+  }
+
+  cache_entry_t* entries = NULL;
+  size_t entry_count = 0;
+  size_t entry_capacity = 0;
+  uint64_t total = 0;
+  time_t now = time(NULL);
+
+  struct dirent* dirent;
+  while ((dirent = readdir(dir)) != NULL) {
+    struct stat st;
+    if (fstatat(dirfd(dir), dirent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+
+    // Temporary files belong to unpacks still writing, unless they are old
+    if (strncmp(dirent->d_name, "tmp.", 4) == 0) {
+      if (now - st.st_mtime > CACHE_STALE_TEMP_AGE) {
+        unlinkat(dirfd(dir), dirent->d_name, 0);
+      }
+      continue;
+    }
+    if (strlen(dirent->d_name) != CACHE_KEY_LENGTH - 1) {
+      continue;
+    }
+
+    if (entry_count == entry_capacity) {
+      entry_capacity = (entry_capacity == 0) ? 256 : 2 * entry_capacity;
+      entries = realloc(entries, entry_capacity * sizeof(cache_entry_t));
+      if (entries == NULL) {
+        error_and_exit("ERROR: malloc failed\n");
+      }
+    }
+    strcpy(entries[entry_count].name, dirent->d_name);
+    entries[entry_count].last_used = st.st_mtim;
+    entries[entry_count].size = st.st_size;
+    total += st.st_size;
+    entry_count++;
+  }
+
+  // Hits refresh an entry's modification time, so the oldest go first
+  if (total > max_bytes) {
+    qsort(entries, entry_count, sizeof(cache_entry_t), compare_last_used);
+    for (size_t i = 0; i < entry_count && total > max_bytes; i++) {
+      if (unlinkat(dirfd(dir), entries[i].name, 0) == 0) {
+        total -= entries[i].size;
+      }
+    }
+  }
+
+  free(entries);
+  closedir(dir);
+  close(lock_fd);
+}
+
+// --- public functions ---
+
+void sha256_init(sha256_t* hash) {
+  static const uint32_t initial_state[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+  };
+  memcpy(hash->state, initial_state, sizeof(initial_state));
+  hash->total_len = 0;
+  hash->block_len = 0;
+}
+
+void sha256_update(sha256_t* hash, const uint8_t* input_data, size_t input_len) {
+  hash->total_len += input_len;
+
+  // Top up a partially filled block first
+  if (hash->block_len > 0) {
+    size_t len = 64 - hash->block_len;
+    if (len > input_len) {
+      len = input_len;
+    }
+    memcpy(&(hash->block[hash->block_len]), input_data, len);
+    hash->block_len += len;
+    input_data += len;
+    input_len -= len;
+    if (hash->block_len < 64) {
+      return;
+    }
+    sha256_blocks(hash->state, hash->block, 1);
+    hash->block_len = 0;
+  }
+
+  // Then hash full blocks straight from the input
+  size_t block_count = input_len / 64;
+  sha256_blocks(hash->state, input_data, block_count);
+  input_data += 64 * block_count;
+  input_len -= 64 * block_count;
+
+  if (input_len > 0) {
+    memcpy(hash->block, input_data, input_len);
+    hash->block_len = input_len;
+  }
+}
+
+void sha256_final(sha256_t* hash, uint8_t* digest) {
+  uint64_t bit_len = hash->total_len * 8;
+
+  // Pad with a one bit, zeros, and the big-endian message length in bits
+  uint8_t padding[72] = {0x80};
+  size_t padding_len = (hash->block_len < 56) ? (56 - hash->block_len) : (120 - hash->block_len);
+  for (int i = 0; i < 8; i++) {
+    padding[padding_len + i] = bit_len >> (56 - 8 * i);
+  }
+  sha256_update(hash, padding, padding_len + 8);
+
+  for (int i = 0; i < 8; i++) {
+    digest[4 * i] = hash->state[i] >> 24;
+    digest[4 * i + 1] = hash->state[i] >> 16;
+    digest[4 * i + 2] = hash->state[i] >> 8;
+    digest[4 * i + 3] = hash->state[i];
+  }
+}
+
+void cache_key(const uint8_t* header, size_t header_len,
+               const uint8_t* payload, size_t payload_len,
+               bool is_encrypted, uint16_t encryption_key,
+               char* key) {
+  sha256_t hash;
+  sha256_init(&hash);
+  sha256_update(&hash, header, header_len);
+  sha256_update(&hash, payload, payload_len);
+  if (is_encrypted) {
+    uint8_t key_bytes[2] = {encryption_key >> 8, encryption_key & 0xFF};
+    sha256_update(&hash, key_bytes, sizeof(key_bytes));
+  }
+
+  uint8_t digest[32];
+  sha256_final(&hash, digest);
+  for (int i = 0; i < 32; i++) {
+    snprintf(&(key[2 * i]), 3, "%02x", digest[i]);
+  }
+}
+
+bool cache_fetch(const char* cache_dir, const char* key, const char* output_filename) {
+  char path[CACHE_PATH_LENGTH];
+  if (!cache_path(path, cache_dir, key)) {
+    return false;
+  }
+
+  // An entry evicted after this open stays readable until it is closed
+  int input_fd = open(path, O_RDONLY);
+  if (input_fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(input_fd, &st) != 0) {
+    close(input_fd);
+    return false;
+  }
+
+  int output_fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (output_fd < 0) {
+    close(input_fd);
+    return false;
+  }
+  bool copied = copy_file(input_fd, output_fd, st.st_size);
+  close(output_fd);
+
+  // Mark the entry as recently used for eviction
+  if (copied) {
+    futimens(input_fd, NULL);
+  }
+  close(input_fd);
+  return copied;
+}
+
+void cache_store(const char* cache_dir, const char* key,
+                 const uint8_t* data, size_t len, uint64_t max_bytes) {
+  // Entries larger than the whole cache would only be evicted again
+  if ((uint64_t)len > max_bytes) {
+    return;
+  }
+
+  // Write to a temporary file, then rename it into place in one step
+  char temp_path[CACHE_PATH_LENGTH];
+  char path[CACHE_PATH_LENGTH];
+  mkdir(cache_dir, 0700);
+  if (!cache_path(temp_path, cache_dir, "tmp.XXXXXX") || !cache_path(path, cache_dir, key)) {
+    return;
+  }
+  int fd = mkstemp(temp_path);
+  if (fd < 0) {
+    return;
+  }
+  // mkstemp() creates the file 0600, which is kept as is
+  bool written = write_sparse(fd, data, len);
+  if (close(fd) != 0) {
+    written = false;
+  }
+  if (!written || rename(temp_path, path) != 0) {
+    unlink(temp_path);
+    return;
+  }
+
+  cache_evict(cache_dir, max_bytes);
+}
@@ -0,0 +1,61 @@
+// Content-addressed cache of unpacked output
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Definitions
+#define CACHE_KEY_LENGTH 65 // 64 hex digits plus NUL
+#define CACHE_DEFAULT_MAX_BYTES (1ULL << 30)
+// Payloads smaller than this aren't worth caching
+#define CACHE_MIN_BYTES (64 * 1024)
+
+// Running SHA-256 state
+typedef struct {
+  uint32_t state[8];
+  uint64_t total_len;
+  uint8_t block[64];
+  size_t block_len;
+} sha256_t;
+
+// Starts a new SHA-256 hash
+void sha256_init(sha256_t* hash);
+
+// Adds input data to the hash
+void sha256_update(sha256_t* hash, const uint8_t* input_data, size_t input_len);
+
+// Finishes the hash and writes the 32-byte digest
+void sha256_final(sha256_t* hash, uint8_t* digest);
+
+// Calculates the cache key for a packed file: the SHA-256 of its header bytes
+// and payload, plus the encryption key if the file is encrypted (the same
+// pack unpacks differently under different passwords)
+// Hits are returned without checking the stored output, so the key has to
+// hold up against packs crafted to collide with another pack's key
+// Uses the SHA extensions when the CPU supports them, which keeps hashing
+// well below the cost of the decode a hit saves
+// The key is written as a NUL-terminated hex string
+void cache_key(const uint8_t* header, size_t header_len,
+               const uint8_t* payload, size_t payload_len,
+               bool is_encrypted, uint16_t encryption_key,
+               char* key);
+
+// Looks up `key` in the cache directory and, if present, writes the cached
+// output to `output_filename` (as a reflink when the filesystem supports it)
+// Returns true on a hit, false on a miss or if the copy failed
+bool cache_fetch(const char* cache_dir, const char* key, const char* output_filename);
+
+// Stores the `len` bytes of decoded output in `data` under `key` in the cache
+// directory, then evicts the least recently used entries until the cache
+// holds at most max_bytes
+// Storing from the decoded data, rather than the output file, keeps entries
+// correct when the output was a pipe or device that can't be read back
+// Entries appear atomically, so concurrent unpacks never see partial output
+// Failures are silently ignored, since the cache is only an optimization
+// Entries hold decoded output, which for encrypted packs is the plaintext at
+// rest; the cache directory is created 0700 and entries 0600 to keep it private
+void cache_store(const char* cache_dir, const char* key,
+                 const uint8_t* data, size_t len, uint64_t max_bytes);
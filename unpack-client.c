@@ -0,0 +1,104 @@
+// Client library for the unpack daemon
+// PackLab - CS213 - Northwestern University
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "unpack-client.h"
+#include "unpack-socket.h"
+#include "unpack-utilities.h"
+
+// Copies a string into a fixed-size request field
+// Returns false if it doesn't fit
+static bool copy_field(char* field, size_t field_len, const char* value) {
+  if (value == NULL) {
+    field[0] = '\0';
+    return true;
+  }
+  if (strlen(value) >= field_len) {
+    return false;
+  }
+  strcpy(field, value);
+  return true;
+}
+
+// Sends all of data over a socket
+// MSG_NOSIGNAL keeps a daemon that went away from killing the caller with SIGPIPE
+static bool send_all(int connection, const void* data, size_t len) {
+  const uint8_t* position = data;
+  while (len > 0) {
+    ssize_t sent = send(connection, position, len, MSG_NOSIGNAL);
+    if (sent < 0) {
+      return false;
+    }
+    position += sent;
+    len -= sent;
+  }
+  return true;
+}
+
+// --- public functions ---
+
+int unpack_client_connect(const char* socket_path) {
+  struct sockaddr_un address = {0};
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connection < 0) {
+    return -1;
+  }
+  if (connect(connection, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(connection);
+    return -1;
+  }
+
+  // A socket some other user put at this path must never see the password
+  if (!peer_is_same_user(connection)) {
+    close(connection);
+    return -1;
+  }
+  return connection;
+}
+
+bool unpack_client_request(int connection, uint32_t op,
+                           const char* input_path, const char* output_path,
+                           const char* password,
+                           uint64_t range_offset, uint64_t range_len,
+                           daemon_response_t* response) {
+  daemon_request_t request;
+  memset(&request, 0, sizeof(request));
+  request.op = op;
+  request.has_password = (password != NULL);
+  request.range_offset = range_offset;
+  request.range_len = range_len;
+  if (!copy_field(request.password, sizeof(request.password), password) ||
+      !copy_field(request.input_path, sizeof(request.input_path), input_path) ||
+      !copy_field(request.output_path, sizeof(request.output_path), output_path)) {
+    return false;
+  }
+
+  if (!send_all(connection, &request, sizeof(request))) {
+    return false;
+  }
+  if (!read_all(connection, response, sizeof(*response))) {
+    return false;
+  }
+  response->message[sizeof(response->message) - 1] = '\0';
+  return true;
+}
+
+void unpack_client_close(int connection) {
+  close(connection);
+}
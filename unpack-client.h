@@ -0,0 +1,32 @@
+// Client library for the unpack daemon
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "unpack-daemon.h"
+
+// Connects to the unpack daemon listening on `socket_path`
+// Returns the connection's file descriptor, or -1 if it could not connect or
+// the daemon runs as a different user
+// One connection can be reused for many requests
+int unpack_client_connect(const char* socket_path);
+
+// Sends one request over `connection` and waits for the daemon's response
+// `password` may be NULL for files that aren't encrypted
+// `output_path` is ignored when verifying, and the range is ignored unless
+// `op` is DAEMON_OP_RANGE
+// Returns false if the request could not be sent or answered (the
+// connection should then be closed); daemon-side failures are reported in
+// response->status instead
+bool unpack_client_request(int connection, uint32_t op,
+                           const char* input_path, const char* output_path,
+                           const char* password,
+                           uint64_t range_offset, uint64_t range_len,
+                           daemon_response_t* response);
+
+// Closes a connection from unpack_client_connect()
+void unpack_client_close(int connection);
@@ -0,0 +1,470 @@
+// Long-running daemon that unpacks files on request over a Unix domain socket
+// PackLab - CS213 - Northwestern University
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unpack-daemon.h"
+#include "unpack-keystream.h"
+#include "unpack-socket.h"
+#include "unpack-utilities.h"
+
+// Definitions
+// Buffers larger than this are freed after each request instead of kept
+#define BUFFER_KEEP_LENGTH (64 << 20)
+// How long a client may take to send a request it started, or to take a response
+#define CONNECTION_TIMEOUT_SECONDS 5
+// How long to stop accepting after running out of descriptors or memory
+#define ACCEPT_BACKOFF_MS 100
+
+// A reusable heap buffer, so steady-state requests don't allocate
+typedef struct {
+  uint8_t* data;
+  size_t capacity;
+} buffer_t;
+
+// Everything one worker thread keeps between requests
+typedef struct {
+  buffer_t input;
+  buffer_t decrypted;
+  buffer_t decompressed;
+  keystream_cache_t keystreams;
+} worker_t;
+
+// Connections with a request ready to read, waiting for a free worker
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  int* connections;
+  size_t head;
+  size_t count;
+  size_t capacity;
+} connection_queue_t;
+
+// Socket path, removed again when the daemon is stopped
+static const char* socket_path = NULL;
+
+// The poll loop queues connections here as soon as a request arrives
+static connection_queue_t ready_queue = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .not_empty = PTHREAD_COND_INITIALIZER,
+};
+
+// Workers hand connections back to the poll loop through this pipe after
+// answering one request, so idle connections never hold a worker
+static int return_pipe[2];
+
+static void stop_daemon(int signal_number) {
+  (void)signal_number;
+  unlink(socket_path);
+  _exit(0);
+}
+
+// Makes sure buffer can hold at least len bytes
+// Returns false if the memory isn't available
+static bool reserve(buffer_t* buffer, size_t len) {
+  if (len <= buffer->capacity) {
+    return true;
+  }
+  size_t capacity = (buffer->capacity == 0) ? 4096 : buffer->capacity;
+  while (capacity < len) {
+    capacity *= 2;
+  }
+  uint8_t* data = realloc(buffer->data, capacity);
+  if (data == NULL) {
+    return false;
+  }
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return true;
+}
+
+// Frees a buffer that grew past BUFFER_KEEP_LENGTH for one large request
+static void shrink(buffer_t* buffer) {
+  if (buffer->capacity > BUFFER_KEEP_LENGTH) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+  }
+}
+
+static void queue_push(int connection) {
+  pthread_mutex_lock(&ready_queue.lock);
+  if (ready_queue.count == ready_queue.capacity) {
+    // Grow the ring, unwrapping it into the new space
+    size_t capacity = (ready_queue.capacity == 0) ? 64 : 2 * ready_queue.capacity;
+    int* connections = malloc_and_check(capacity * sizeof(int));
+    for (size_t i = 0; i < ready_queue.count; i++) {
+      connections[i] = ready_queue.connections[(ready_queue.head + i) % ready_queue.capacity];
+    }
+    free(ready_queue.connections);
+    ready_queue.connections = connections;
+    ready_queue.head = 0;
+    ready_queue.capacity = capacity;
+  }
+  ready_queue.connections[(ready_queue.head + ready_queue.count) % ready_queue.capacity] = connection;
+  ready_queue.count++;
+  pthread_cond_signal(&ready_queue.not_empty);
+  pthread_mutex_unlock(&ready_queue.lock);
+}
+
+static int queue_pop(void) {
+  pthread_mutex_lock(&ready_queue.lock);
+  while (ready_queue.count == 0) {
+    pthread_cond_wait(&ready_queue.not_empty, &ready_queue.lock);
+  }
+  int connection = ready_queue.connections[ready_queue.head];
+  ready_queue.head = (ready_queue.head + 1) % ready_queue.capacity;
+  ready_queue.count--;
+  pthread_mutex_unlock(&ready_queue.lock);
+  return connection;
+}
+
+static uint64_t monotonic_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Carries out one request
+// Returns NULL on success, or an error message
+static const char* handle_request(worker_t* worker, const daemon_request_t* request,
+                                  uint64_t* output_len) {
+  // Read entire input file contents into the reusable input buffer
+  int input_fd = open(request->input_path, O_RDONLY);
+  if (input_fd < 0) {
+    return "ERROR: input file likely does not exist\n";
+  }
+  struct stat st;
+  if (fstat(input_fd, &st) != 0) {
+    close(input_fd);
+    return "ERROR: input file likely does not exist\n";
+  }
+  size_t input_len = st.st_size;
+  if (!reserve(&(worker->input), input_len)) {
+    close(input_fd);
+    return "ERROR: malloc failed\n";
+  }
+  bool read_ok = read_all(input_fd, worker->input.data, input_len);
+  close(input_fd);
+  if (!read_ok) {
+    return "ERROR: read failed on input\n";
+  }
+
+  // Parse and validate the header
+  packlab_config_t config = {0};
+  parse_header(worker->input.data, input_len, &config);
+  if (!config.is_valid) {
+    return "ERROR: header is invalid\n";
+  }
+  if (config.header_len > input_len) {
+    return "ERROR: input file is shorter than expected\n";
+  }
+  uint8_t* data = &(worker->input.data[config.header_len]);
+  size_t data_len = input_len - config.header_len;
+
+  // Handle checksumming
+  // The key arrives with the request, so the CRC32C of an encrypted pack is
+  // checked while it is decrypted below instead of in a pass of its own
+  bool check_while_decrypting = config.is_checksummed && config.is_crc32c &&
+                                config.is_encrypted && request->has_password &&
+                                request->op != DAEMON_OP_VERIFY;
+  if (config.is_checksummed && config.is_crc32c) {
+    if (!check_while_decrypting && calculate_crc32c(data, data_len) != config.crc32c_value) {
+      return "ERROR: checksum is invalid\n";
+    }
+  } else if (config.is_checksummed) {
+    if (calculate_checksum(data, data_len) != config.checksum_value) {
+      return "ERROR: checksum is invalid\n";
+    }
+  }
+
+  if (request->op == DAEMON_OP_VERIFY) {
+    *output_len = data_len;
+    return NULL;
+  }
+
+  // Handle decryption
+  if (config.is_encrypted) {
+    if (!request->has_password) {
+      return "ERROR: invalid password entered\n";
+    }
+    // Same lazy password "hash" as the unpack program
+    uint8_t password[DAEMON_PASSWORD_LENGTH];
+    size_t password_len = strlen(request->password);
+    memcpy(password, request->password, password_len);
+    uint16_t encryption_key = calculate_checksum(password, password_len);
+    if (!reserve(&(worker->decrypted), data_len)) {
+      return "ERROR: malloc failed\n";
+    }
+    if (check_while_decrypting) {
+      uint32_t crc = decrypt_cached_crc32c(&(worker->keystreams), data, data_len,
+                                           worker->decrypted.data, encryption_key);
+      if (crc != config.crc32c_value) {
+        return "ERROR: checksum is invalid\n";
+      }
+    } else {
+      decrypt_cached(&(worker->keystreams), data, data_len, worker->decrypted.data, encryption_key);
+    }
+    data = worker->decrypted.data;
+  }
+
+  // Handle decompression
+  if (config.is_compressed) {
+    size_t decompressed_len = decompressed_length(data, data_len);
+    if (!reserve(&(worker->decompressed), decompressed_len)) {
+      return "ERROR: malloc failed\n";
+    }
+    data_len = decompress_data(data, data_len, worker->decompressed.data,
+                               decompressed_len, config.dictionary_data);
+    data = worker->decompressed.data;
+  }
+
+  // Narrow to the requested range of the decoded output
+  if (request->op == DAEMON_OP_RANGE) {
+    size_t offset = (request->range_offset < data_len) ? request->range_offset : data_len;
+    size_t len = data_len - offset;
+    if (request->range_len < len) {
+      len = request->range_len;
+    }
+    data = &(data[offset]);
+    data_len = len;
+  }
+
+  // Write data to output file
+  int output_fd = open(request->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (output_fd < 0) {
+    return "ERROR: could not open output file\n";
+  }
+  bool write_ok = write_sparse(output_fd, data, data_len);
+  close(output_fd);
+  if (!write_ok) {
+    return "ERROR: could not write output file data\n";
+  }
+
+  *output_len = data_len;
+  return NULL;
+}
+
+// Answers one request on a client connection
+// Returns false if the connection failed or was closed by the client
+static bool serve_request(worker_t* worker, int connection) {
+  daemon_request_t request;
+  if (!read_all(connection, &request, sizeof(request))) {
+    return false;
+  }
+
+  // Never trust the client to have terminated its strings
+  request.password[DAEMON_PASSWORD_LENGTH - 1] = '\0';
+  request.input_path[DAEMON_PATH_LENGTH - 1] = '\0';
+  request.output_path[DAEMON_PATH_LENGTH - 1] = '\0';
+
+  daemon_response_t response;
+  memset(&response, 0, sizeof(response));
+  const char* message = NULL;
+  uint64_t output_len = 0;
+  if (request.op != DAEMON_OP_UNPACK && request.op != DAEMON_OP_VERIFY &&
+      request.op != DAEMON_OP_RANGE) {
+    message = "ERROR: unknown request\n";
+  } else {
+    message = handle_request(worker, &request, &output_len);
+  }
+
+  // Don't let one huge request pin its memory in this worker for good
+  shrink(&(worker->input));
+  shrink(&(worker->decrypted));
+  shrink(&(worker->decompressed));
+
+  response.output_len = output_len;
+  if (message != NULL) {
+    response.status = 1;
+    snprintf(response.message, sizeof(response.message), "%s", message);
+  }
+  return write_all(connection, &response, sizeof(response));
+}
+
+static void* worker_thread(void* arg) {
+  worker_t* worker = arg;
+
+  // Take one ready connection at a time, answer its request, and give the
+  // connection back to the poll loop to wait for the next one
+  while (true) {
+    int connection = queue_pop();
+    if (serve_request(worker, connection)) {
+      if (write(return_pipe[1], &connection, sizeof(connection)) != sizeof(connection)) {
+        close(connection);
+      }
+    } else {
+      close(connection);
+    }
+  }
+
+  return NULL;
+}
+
+// Adds a descriptor to the poll set, growing it as needed
+static void add_poll_fd(struct pollfd** fds, size_t* count, size_t* capacity, int fd) {
+  if (*count == *capacity) {
+    *capacity *= 2;
+    *fds = realloc(*fds, *capacity * sizeof(struct pollfd));
+    if (*fds == NULL) {
+      error_and_exit("ERROR: malloc failed\n");
+    }
+  }
+  (*fds)[*count].fd = fd;
+  (*fds)[*count].events = POLLIN;
+  (*fds)[*count].revents = 0;
+  (*count)++;
+}
+
+// Accepts new clients and watches idle connections, queueing each one for a
+// worker as soon as it has a request (or hangs up)
+static void dispatch_loop(int listen_fd) {
+  size_t capacity = 64;
+  size_t count = 0;
+  struct pollfd* fds = malloc_and_check(capacity * sizeof(struct pollfd));
+  add_poll_fd(&fds, &count, &capacity, listen_fd);
+  add_poll_fd(&fds, &count, &capacity, return_pipe[0]);
+  uint64_t resume_accept_ms = 0;
+
+  while (true) {
+    // While accepting is backed off, leave the listening socket out of the set
+    bool accept_paused = resume_accept_ms != 0 && monotonic_ms() < resume_accept_ms;
+    fds[0].fd = accept_paused ? -1 : listen_fd;
+    if (poll(fds, count, accept_paused ? ACCEPT_BACKOFF_MS : -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error_and_exit("ERROR: poll failed\n");
+    }
+
+    // Queue connections with something to read, walking backwards so
+    // removing one (by moving the last entry into its slot) skips nothing
+    for (size_t i = count - 1; i >= 2; i--) {
+      if (fds[i].revents != 0) {
+        queue_push(fds[i].fd);
+        fds[i] = fds[count - 1];
+        count--;
+      }
+    }
+
+    // Take back connections that workers have finished with
+    if (fds[1].revents != 0) {
+      int returned[64];
+      ssize_t read_len = read(return_pipe[0], returned, sizeof(returned));
+      for (ssize_t i = 0; i < read_len / (ssize_t)sizeof(int); i++) {
+        add_poll_fd(&fds, &count, &capacity, returned[i]);
+      }
+    }
+
+    // Accept every waiting client
+    while (fds[0].fd >= 0 && fds[0].revents != 0) {
+      int connection = accept(listen_fd, NULL, NULL);
+      if (connection < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          // Out of descriptors or memory: back off rather than spin
+          resume_accept_ms = monotonic_ms() + ACCEPT_BACKOFF_MS;
+        }
+        break;
+      }
+
+      // Other users could otherwise have files opened and truncated as this one
+      if (!peer_is_same_user(connection)) {
+        close(connection);
+        continue;
+      }
+
+      // A client that stalls partway through a request must not hold a worker
+      struct timeval timeout = {.tv_sec = CONNECTION_TIMEOUT_SECONDS};
+      setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      add_poll_fd(&fds, &count, &capacity, connection);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  // Parse app flags
+  // Optional socket path, defaulting to DAEMON_SOCKET_NAME in the runtime directory
+  if (argc > 2) {
+    printf("usage: %s [socketpath]\n", argv[0]);
+    error_and_exit("\n");
+  }
+  static char default_path[DAEMON_PATH_LENGTH];
+  if (argc == 2) {
+    socket_path = argv[1];
+  } else if (default_socket_path(default_path, sizeof(default_path))) {
+    socket_path = default_path;
+  } else {
+    error_and_exit("ERROR: socket path is too long\n");
+  }
+
+  struct sockaddr_un address = {0};
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    error_and_exit("ERROR: socket path is too long\n");
+  }
+  strcpy(address.sun_path, socket_path);
+
+  // Listen on the socket, replacing any left behind by an earlier daemon
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    error_and_exit("ERROR: could not create socket\n");
+  }
+  // The socket is created 0600, so only this user can even connect
+  unlink(socket_path);
+  mode_t old_umask = umask(0077);
+  int bind_result = bind(listen_fd, (struct sockaddr*)&address, sizeof(address));
+  umask(old_umask);
+  if (bind_result != 0 || chmod(socket_path, 0600) != 0 ||
+      listen(listen_fd, SOMAXCONN) != 0) {
+    error_and_exit("ERROR: could not listen on socket\n");
+  }
+  fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+  if (pipe(return_pipe) != 0) {
+    error_and_exit("ERROR: could not create pipe\n");
+  }
+
+  // Clients that hang up early must not take the daemon down with them
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction stop = {0};
+  stop.sa_handler = stop_daemon;
+  sigaction(SIGINT, &stop, NULL);
+  sigaction(SIGTERM, &stop, NULL);
+
+  // Start the worker pool, one worker per CPU
+  long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t worker_count = (cpu_count > 0) ? (size_t)cpu_count : 1;
+  worker_t* workers = malloc_and_check(worker_count * sizeof(worker_t));
+  pthread_t* threads = malloc_and_check(worker_count * sizeof(pthread_t));
+  memset(workers, 0, worker_count * sizeof(worker_t));
+  for (size_t i = 0; i < worker_count; i++) {
+    if (pthread_create(&threads[i], NULL, worker_thread, &workers[i]) != 0) {
+      error_and_exit("ERROR: could not create thread\n");
+    }
+  }
+
+  // The main thread dispatches connections until the daemon is signalled
+  dispatch_loop(listen_fd);
+
+  return 0;
+}
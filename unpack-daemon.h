@@ -0,0 +1,57 @@
+// Request protocol for the unpack daemon
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdint.h>
+
+// Definitions
+// Socket file name, placed in the user's runtime directory by default
+#define DAEMON_SOCKET_NAME "packlab-unpack.sock"
+#define DAEMON_PATH_LENGTH 1024
+#define DAEMON_PASSWORD_LENGTH 80
+#define DAEMON_MESSAGE_LENGTH 128
+
+// Request operations
+// Unpack the whole input file into the output file
+#define DAEMON_OP_UNPACK 1
+// Check the header and checksum only, nothing is written
+#define DAEMON_OP_VERIFY 2
+// Unpack only bytes [range_offset, range_offset + range_len) of the output
+#define DAEMON_OP_RANGE 3
+
+// One request, sent as raw bytes over the daemon's Unix domain socket
+// A connection may carry any number of requests, each answered in order, and
+// may sit idle between them; a request must arrive in full within a few seconds
+// Paths are absolute, since the daemon does not share the client's working directory
+// Only clients running as the daemon's own user are served
+typedef struct {
+  // which DAEMON_OP_* to perform
+  uint32_t op;
+
+  // whether password holds the password for an encrypted file
+  uint32_t has_password;
+
+  // range of decoded output to write
+  // (only used for DAEMON_OP_RANGE)
+  uint64_t range_offset;
+  uint64_t range_len;
+
+  // NUL-terminated strings
+  char password[DAEMON_PASSWORD_LENGTH];
+  char input_path[DAEMON_PATH_LENGTH];
+  char output_path[DAEMON_PATH_LENGTH];
+} daemon_request_t;
+
+// The daemon's answer to one request
+typedef struct {
+  // zero on success, nonzero on failure
+  int32_t status;
+
+  // bytes written to the output file, or the payload length when verifying
+  uint64_t output_len;
+
+  // NUL-terminated error message, same wording as the unpack program
+  // (only valid if status is nonzero)
+  char message[DAEMON_MESSAGE_LENGTH];
+} daemon_response_t;
@@ -0,0 +1,117 @@
+// Cache of decryption keystreams, for decrypting many files with few keys
+// PackLab - CS213 - Northwestern University
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unpack-keystream.h"
+#include "unpack-utilities.h"
+
+// Finds (or creates, evicting the least recently used) the cached keystream
+// for `key`, and extends it to cover up to `len` bytes where the cache allows
+// Returns NULL if there is no memory for a new entry
+static keystream_entry_t* get_keystream(keystream_cache_t* cache, uint16_t key, size_t len) {
+  cache->use_count++;
+
+  keystream_entry_t* entry = NULL;
+  for (int i = 0; i < KEYSTREAM_CACHE_ENTRIES; i++) {
+    keystream_entry_t* candidate = &(cache->entries[i]);
+    if (candidate->in_use && candidate->key == key) {
+      entry = candidate;
+      break;
+    }
+    if (entry == NULL || !candidate->in_use ||
+        (entry->in_use && candidate->last_used < entry->last_used)) {
+      entry = candidate;
+    }
+  }
+
+  if (!entry->in_use || entry->key != key) {
+    if (entry->stream == NULL) {
+      entry->stream = malloc(KEYSTREAM_CACHE_LENGTH);
+      if (entry->stream == NULL) {
+        return NULL;
+      }
+    }
+    entry->in_use = true;
+    entry->key = key;
+    entry->len = 0;
+    entry->next_state = lfsr_step(key);
+  }
+  entry->last_used = cache->use_count;
+
+  // Keep the cached length even, so next_state always lines up with a byte pair
+  size_t wanted = (len > KEYSTREAM_CACHE_LENGTH) ? KEYSTREAM_CACHE_LENGTH : len;
+  wanted += wanted % 2;
+  if (wanted > entry->len) {
+    lfsr_keystream(&(entry->next_state), &(entry->stream[entry->len]), wanted - entry->len);
+    entry->len = wanted;
+  }
+  return entry;
+}
+
+// Decrypts bytes [start, end) of input_data with a cached keystream, where
+// start is even and earlier bytes were decrypted by previous calls
+// *state carries the LFSR past the cached prefix from one call to the next,
+// and must start out as entry->next_state
+static void decrypt_span(const keystream_entry_t* entry, uint16_t* state,
+                         const uint8_t* input_data, uint8_t* output_data,
+                         size_t start, size_t end) {
+  size_t cached_end = (end < entry->len) ? end : entry->len;
+  for (size_t i = start; i < cached_end; i++) {
+    output_data[i] = input_data[i] ^ entry->stream[i];
+  }
+
+  // Anything past the cached prefix continues from where the cache stops
+  uint8_t pair[2];
+  for (size_t i = (start > cached_end) ? start : cached_end; i < end; i += 2) {
+    lfsr_keystream(state, pair, 2);
+    output_data[i] = input_data[i] ^ pair[0];
+    if (i + 1 < end) {
+      output_data[i + 1] = input_data[i + 1] ^ pair[1];
+    }
+  }
+}
+
+// --- public functions ---
+
+void decrypt_cached(keystream_cache_t* cache, uint8_t* input_data, size_t input_len,
+                    uint8_t* output_data, uint16_t encryption_key) {
+  keystream_entry_t* entry = get_keystream(cache, encryption_key, input_len);
+  if (entry == NULL) {
+    decrypt_data(input_data, input_len, output_data, input_len, encryption_key);
+    return;
+  }
+
+  uint16_t state = entry->next_state;
+  decrypt_span(entry, &state, input_data, output_data, 0, input_len);
+}
+
+uint32_t decrypt_cached_crc32c(keystream_cache_t* cache, uint8_t* input_data, size_t input_len,
+                               uint8_t* output_data, uint16_t encryption_key) {
+  keystream_entry_t* entry = get_keystream(cache, encryption_key, input_len);
+  if (entry == NULL) {
+    return decrypt_data_crc32c(input_data, input_len, output_data, input_len, encryption_key);
+  }
+
+  // Same small even-sized blocks as decrypt_data_crc32c(), so each block is
+  // checksummed and decrypted while it is still in cache
+  const size_t block_len = 4096;
+  uint32_t crc = 0;
+  uint16_t state = entry->next_state;
+  for (size_t start = 0; start < input_len; start += block_len) {
+    size_t end = (input_len - start > block_len) ? start + block_len : input_len;
+    crc = extend_crc32c(crc, &(input_data[start]), end - start);
+    decrypt_span(entry, &state, input_data, output_data, start, end);
+  }
+  return crc;
+}
+
+void keystream_cache_free(keystream_cache_t* cache) {
+  for (int i = 0; i < KEYSTREAM_CACHE_ENTRIES; i++) {
+    free(cache->entries[i].stream);
+  }
+  memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,54 @@
+// Cache of decryption keystreams, for decrypting many files with few keys
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Definitions
+// Keystreams remembered by each cache, and how much of each is kept
+#define KEYSTREAM_CACHE_ENTRIES 8
+#define KEYSTREAM_CACHE_LENGTH (1 << 20)
+
+// The start of the keystream for one encryption key
+typedef struct {
+  bool in_use;
+  uint16_t key;
+
+  // keystream bytes generated so far (always an even count)
+  uint8_t* stream;
+  size_t len;
+
+  // LFSR state for the next keystream bytes after `len`
+  uint16_t next_state;
+
+  // use counter value when this entry was last used, for eviction
+  uint64_t last_used;
+} keystream_entry_t;
+
+// The most recently used keystreams
+// Not thread safe: each thread keeps its own cache
+// A zero-initialized cache is empty and ready to use
+typedef struct {
+  keystream_entry_t entries[KEYSTREAM_CACHE_ENTRIES];
+  uint64_t use_count;
+} keystream_cache_t;
+
+// Decrypts input data exactly like decrypt_data(), reusing the first
+// KEYSTREAM_CACHE_LENGTH bytes of the keystream for `encryption_key` from the
+// cache (generating and remembering them on first use)
+// Falls back to decrypt_data() if there is no memory for a new entry
+void decrypt_cached(keystream_cache_t* cache, uint8_t* input_data, size_t input_len,
+                    uint8_t* output_data, uint16_t encryption_key);
+
+// Decrypts input data exactly like decrypt_cached(), while also calculating
+// the CRC32C of the (encrypted) input data in the same pass, like
+// decrypt_data_crc32c()
+// Returns the CRC32C value of all input_len bytes of input_data
+uint32_t decrypt_cached_crc32c(keystream_cache_t* cache, uint8_t* input_data, size_t input_len,
+                               uint8_t* output_data, uint16_t encryption_key);
+
+// Frees the memory held by every cached keystream, leaving the cache empty
+void keystream_cache_free(keystream_cache_t* cache);
@@ -0,0 +1,163 @@
+// Header-only listing of packed files
+// PackLab - CS213 - Northwestern University
+
+#define _XOPEN_SOURCE 700
+
+#include <ftw.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "unpack-list.h"
+#include "unpack-utilities.h"
+
+// Growable list of file paths found while walking the inputs
+typedef struct {
+  char** paths;
+  size_t count;
+  size_t capacity;
+
+  // entries the walk could not stat or directories it could not read
+  size_t failures;
+} found_list_t;
+
+// Shared state for the listing threads
+typedef struct {
+  pthread_mutex_t lock;
+  const found_list_t* found;
+  size_t next_index;
+  size_t failures;
+} list_state_t;
+
+// nftw() has no user data argument, so each walk points this at its own list
+// Being thread-local, concurrent list_packs() calls don't see each other's
+static _Thread_local found_list_t* walk_list = NULL;
+
+static int add_found_path(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+  (void)ftw;
+  found_list_t* found = walk_list;
+
+  if (type == FTW_NS || type == FTW_DNR) {
+    printf("%s: unreadable\n", path);
+    found->failures++;
+    return 0;
+  }
+  // FIFOs, sockets and devices could block or misbehave when opened
+  if (type != FTW_F || !S_ISREG(st->st_mode)) {
+    return 0;
+  }
+
+  if (found->count == found->capacity) {
+    found->capacity = (found->capacity == 0) ? 1024 : 2 * found->capacity;
+    found->paths = realloc(found->paths, found->capacity * sizeof(char*));
+    if (found->paths == NULL) {
+      error_and_exit("ERROR: malloc failed\n");
+    }
+  }
+  found->paths[found->count] = strdup(path);
+  if (found->paths[found->count] == NULL) {
+    error_and_exit("ERROR: malloc failed\n");
+  }
+  found->count++;
+  return 0;
+}
+
+// Prints one line describing the header of `path`
+// Returns false if the file could not be read or its header is invalid
+static bool list_one(const char* path) {
+  packlab_config_t config = {0};
+  size_t payload_len = 0;
+
+  if (!read_pack_header(path, &config, &payload_len)) {
+    printf("%s: unreadable\n", path);
+    return false;
+  }
+  if (!config.is_valid) {
+    printf("%s: invalid header\n", path);
+    return false;
+  }
+
+  char checksum[32] = "none";
+  if (config.is_checksummed && config.is_crc32c) {
+    snprintf(checksum, sizeof(checksum), "crc32c:0x%08X", config.crc32c_value);
+  } else if (config.is_checksummed) {
+    snprintf(checksum, sizeof(checksum), "sum16:0x%04X", config.checksum_value);
+  }
+
+  // A single printf per file keeps lines from different threads intact
+  printf("%s: compressed=%d encrypted=%d checksummed=%d header_len=%lu payload_len=%lu checksum=%s\n",
+         path, config.is_compressed, config.is_encrypted, config.is_checksummed,
+         (unsigned long)config.header_len, (unsigned long)payload_len, checksum);
+  return true;
+}
+
+static void* list_thread(void* arg) {
+  list_state_t* state = arg;
+
+  while (true) {
+    pthread_mutex_lock(&state->lock);
+    size_t index = state->next_index++;
+    pthread_mutex_unlock(&state->lock);
+    if (index >= state->found->count) {
+      break;
+    }
+
+    if (!list_one(state->found->paths[index])) {
+      pthread_mutex_lock(&state->lock);
+      state->failures++;
+      pthread_mutex_unlock(&state->lock);
+    }
+  }
+
+  return NULL;
+}
+
+// --- public functions ---
+
+size_t list_packs(char** paths, size_t path_count, size_t thread_count) {
+  size_t failures = 0;
+  found_list_t found = {0};
+
+  // Gather every regular file under the inputs, without following symlinks
+  walk_list = &found;
+  for (size_t i = 0; i < path_count; i++) {
+    if (nftw(paths[i], add_found_path, 64, FTW_PHYS) != 0) {
+      printf("%s: unreadable\n", paths[i]);
+      failures++;
+    }
+  }
+  walk_list = NULL;
+
+  if (thread_count > found.count) {
+    thread_count = found.count;
+  }
+  if (thread_count == 0) {
+    thread_count = 1;
+  }
+
+  list_state_t state = {.found = &found, .next_index = 0, .failures = 0};
+  pthread_mutex_init(&state.lock, NULL);
+
+  pthread_t* threads = malloc_and_check(thread_count * sizeof(pthread_t));
+  for (size_t t = 0; t < thread_count; t++) {
+    if (pthread_create(&threads[t], NULL, list_thread, &state) != 0) {
+      error_and_exit("ERROR: could not create thread\n");
+    }
+  }
+  for (size_t t = 0; t < thread_count; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&state.lock);
+
+  for (size_t i = 0; i < found.count; i++) {
+    free(found.paths[i]);
+  }
+  free(found.paths);
+
+  return failures + found.failures + state.failures;
+}
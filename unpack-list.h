@@ -0,0 +1,13 @@
+// Header-only listing of packed files
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdlib.h>
+
+// Prints the header configuration of every packed file under `paths`
+// Each path may be a file or a directory, which is searched recursively for
+// regular files (FIFOs, sockets and devices are skipped)
+// Headers are read with `thread_count` threads, so output order is unspecified
+// Returns the number of files that could not be read or had invalid headers
+size_t list_packs(char** paths, size_t path_count, size_t thread_count);
@@ -0,0 +1,118 @@
+// Application to unpack files through the unpack daemon
+// PackLab - CS213 - Northwestern University
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unpack-client.h"
+#include "unpack-socket.h"
+#include "unpack-utilities.h"
+
+// Writes the absolute form of `path` into absolute (of DAEMON_PATH_LENGTH bytes)
+// The path doesn't need to exist, since output files usually don't yet
+static void make_absolute(const char* path, char* absolute) {
+  char cwd[DAEMON_PATH_LENGTH];
+  int len = 0;
+  if (path[0] == '/') {
+    len = snprintf(absolute, DAEMON_PATH_LENGTH, "%s", path);
+  } else if (getcwd(cwd, sizeof(cwd)) != NULL) {
+    len = snprintf(absolute, DAEMON_PATH_LENGTH, "%s/%s", cwd, path);
+  } else {
+    error_and_exit("ERROR: could not determine working directory\n");
+  }
+  if (len < 0 || len >= DAEMON_PATH_LENGTH) {
+    error_and_exit("ERROR: path is too long\n");
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  // Parse app flags
+  // Optional `-s socketpath`, then the operation and its arguments
+  char default_path[DAEMON_PATH_LENGTH];
+  const char* socket_path = default_path;
+  int arg = 1;
+  if (argc >= 3 && strcmp(argv[1], "-s") == 0) {
+    socket_path = argv[2];
+    arg = 3;
+  } else if (!default_socket_path(default_path, sizeof(default_path))) {
+    error_and_exit("ERROR: socket path is too long\n");
+  }
+
+  uint32_t op = 0;
+  int expected_args = 0;
+  if (arg < argc && strcmp(argv[arg], "unpack") == 0) {
+    op = DAEMON_OP_UNPACK;
+    expected_args = 2;
+  } else if (arg < argc && strcmp(argv[arg], "verify") == 0) {
+    op = DAEMON_OP_VERIFY;
+    expected_args = 1;
+  } else if (arg < argc && strcmp(argv[arg], "range") == 0) {
+    op = DAEMON_OP_RANGE;
+    expected_args = 4;
+  }
+  if (op == 0 || argc - arg - 1 != expected_args) {
+    printf("usage: %s [-s socketpath] unpack inputfilename outputfilename\n", argv[0]);
+    printf("       %s [-s socketpath] verify inputfilename\n", argv[0]);
+    printf("       %s [-s socketpath] range inputfilename outputfilename offset length\n", argv[0]);
+    error_and_exit("\n");
+  }
+
+  char input_path[DAEMON_PATH_LENGTH];
+  char output_path[DAEMON_PATH_LENGTH] = "";
+  make_absolute(argv[arg + 1], input_path);
+  if (op != DAEMON_OP_VERIFY) {
+    make_absolute(argv[arg + 2], output_path);
+    if (strcmp(input_path, output_path) == 0) {
+      // This check is for safety to make sure we don't overwrite a file
+      error_and_exit("ERROR: input and output filename match\n");
+    }
+  }
+  uint64_t range_offset = 0;
+  uint64_t range_len = 0;
+  if (op == DAEMON_OP_RANGE) {
+    range_offset = strtoull(argv[arg + 3], NULL, 0);
+    range_len = strtoull(argv[arg + 4], NULL, 0);
+  }
+
+  // Only ask for a password if the header says the file is encrypted
+  packlab_config_t config = {0};
+  size_t payload_len = 0;
+  char password[80];
+  bool has_password = false;
+  if (op != DAEMON_OP_VERIFY && read_pack_header(input_path, &config, &payload_len) &&
+      config.is_valid && config.is_encrypted) {
+    printf("Type the file password and hit enter: ");
+    int match_count = scanf("%79s", password);
+    if (match_count != 1) {
+      error_and_exit("ERROR: invalid password entered\n");
+    }
+    has_password = true;
+  }
+
+  // Hand the request to the daemon
+  int connection = unpack_client_connect(socket_path);
+  if (connection < 0) {
+    error_and_exit("ERROR: could not connect to unpack daemon\n");
+  }
+  daemon_response_t response;
+  if (!unpack_client_request(connection, op, input_path, output_path,
+                             has_password ? password : NULL,
+                             range_offset, range_len, &response)) {
+    error_and_exit("ERROR: unpack daemon did not respond\n");
+  }
+  unpack_client_close(connection);
+
+  if (response.status != 0) {
+    error_and_exit(response.message);
+  }
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+// Socket location and peer checks shared by the unpack daemon and its clients
+// PackLab - CS213 - Northwestern University
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "unpack-daemon.h"
+#include "unpack-socket.h"
+
+// --- public functions ---
+
+bool default_socket_path(char* path, size_t path_len) {
+  const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+  int len = 0;
+  if (runtime_dir != NULL && runtime_dir[0] != '\0') {
+    len = snprintf(path, path_len, "%s/%s", runtime_dir, DAEMON_SOCKET_NAME);
+  } else {
+    // Anyone can create names in /tmp, so the peer check is what keeps
+    // another user's socket from being trusted here
+    len = snprintf(path, path_len, "/tmp/%u-%s", (unsigned)geteuid(), DAEMON_SOCKET_NAME);
+  }
+  return len > 0 && (size_t)len < path_len;
+}
+
+bool peer_is_same_user(int connection) {
+  struct ucred credentials;
+  socklen_t len = sizeof(credentials);
+  if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &len) != 0 ||
+      len != sizeof(credentials)) {
+    return false;
+  }
+  return credentials.uid == geteuid();
+}
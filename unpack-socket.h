@@ -0,0 +1,19 @@
+// Socket location and peer checks shared by the unpack daemon and its clients
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Writes the default daemon socket path into path (of path_len bytes):
+// DAEMON_SOCKET_NAME in $XDG_RUNTIME_DIR, which only the user can write, or a
+// per-user name in /tmp when that isn't set
+// Returns false if the path doesn't fit
+bool default_socket_path(char* path, size_t path_len);
+
+// Returns true if the process at the other end of the Unix domain socket
+// `connection` runs as the same user as this one
+// The daemon and its clients trust each other with passwords and output
+// paths, so each side checks this before sending anything
+bool peer_is_same_user(int connection);
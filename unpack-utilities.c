@@ -1,11 +1,17 @@
 // Utilities for unpacking files
 // PackLab - CS213 - Northwestern University
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "unpack-utilities.h"
 
@@ -70,7 +76,8 @@ void parse_header(uint8_t *input_data, size_t input_len, packlab_config_t *confi
   }
 
   // now we analyze the flags to see whether the data is compressed, checksummed, encrypted, or a combination
-  char importantFlagDigits = (input_data[byteNum]) >> 5;
+  uint8_t flagByte = input_data[byteNum];
+  char importantFlagDigits = flagByte >> 5;
   byteNum++; // byteNum should be at 4 now
   // char compressed = 0b100;
   // char encrypted = 0b010;
@@ -80,12 +87,18 @@ void parse_header(uint8_t *input_data, size_t input_len, packlab_config_t *confi
   char compressed = importantFlagDigits & 0x04;
   char encrypted = importantFlagDigits & 0x02;
   char checksum = importantFlagDigits & 0x01;
+
+  // the low flag bits select a 4-byte CRC32C instead of the 2-byte checksum
+  config->is_crc32c = (flagByte & CRC32C_FLAG) != 0;
+  size_t checksumLen = config->is_crc32c ? 4 : 2;
+
   if (compressed != 0)
   {
-    if ((byteNum + 15) <= input_len) {
+    if ((byteNum + DICTIONARY_LENGTH) <= input_len) {
     config->is_compressed = true;
     } else {
       config->is_valid = false;
+      return;
     }
   }
   else
@@ -103,12 +116,13 @@ void parse_header(uint8_t *input_data, size_t input_len, packlab_config_t *confi
   }
   if (checksum != 0)
   {
-    if (config->is_compressed && (byteNum + 17) <= input_len) {
+    if (config->is_compressed && (byteNum + DICTIONARY_LENGTH + checksumLen) <= input_len) {
       config->is_checksummed = true;
-    } else if ((!config->is_compressed) && (byteNum + 1 <= input_len)) {
+    } else if ((!config->is_compressed) && (byteNum + checksumLen <= input_len)) {
       config->is_checksummed = true;
     } else {
       config->is_valid = false;
+      return;
     }
     
   }
@@ -133,7 +147,13 @@ void parse_header(uint8_t *input_data, size_t input_len, packlab_config_t *confi
     }
   }
 
-  if (config->is_checksummed)
+  if (config->is_checksummed && config->is_crc32c)
+  {
+    config->crc32c_value = ((uint32_t)input_data[byteNum] << 24) | ((uint32_t)input_data[byteNum + 1] << 16) |
+                           ((uint32_t)input_data[byteNum + 2] << 8) | input_data[byteNum + 3];
+    byteNum+= 4;
+  }
+  else if (config->is_checksummed)
   {
     config->checksum_value = ((input_data[byteNum] << 8) | input_data[byteNum + 1]);
     byteNum+= 2;
@@ -144,6 +164,165 @@ void parse_header(uint8_t *input_data, size_t input_len, packlab_config_t *confi
   config->is_valid = true;
 }
 
+bool read_pack_header(const char* filename, packlab_config_t* config, size_t* payload_len)
+{
+  // O_NONBLOCK so a FIFO swapped in for the file can't hang the open
+  int fd = open(filename, O_RDONLY | O_NONBLOCK);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat st;
+  uint8_t header[MAX_HEADER_LENGTH];
+  ssize_t read_len = -1;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+  {
+    read_len = pread(fd, header, sizeof(header), 0);
+  }
+  close(fd);
+  if (read_len < 0)
+  {
+    return false;
+  }
+
+  parse_header(header, read_len, config);
+  if (config->is_valid)
+  {
+    *payload_len = st.st_size - config->header_len;
+  }
+  return true;
+}
+
+// Returns true if all len bytes of data are zero
+static bool is_zero(const uint8_t* data, size_t len)
+{
+  return len == 0 || (data[0] == 0 && memcmp(data, data + 1, len - 1) == 0);
+}
+
+bool read_all(int fd, void* data, size_t len)
+{
+  uint8_t* position = data;
+  while (len > 0)
+  {
+    ssize_t read_len = read(fd, position, len);
+    if (read_len <= 0)
+    {
+      return false;
+    }
+    position += read_len;
+    len -= read_len;
+  }
+  return true;
+}
+
+bool write_all(int fd, const void* data, size_t len)
+{
+  const uint8_t* position = data;
+  while (len > 0)
+  {
+    ssize_t written = write(fd, position, len);
+    if (written < 0)
+    {
+      return false;
+    }
+    position += written;
+    len -= written;
+  }
+  return true;
+}
+
+bool write_sparse(int fd, const uint8_t* data, size_t data_len)
+{
+  // Pipes, terminals, and devices like /dev/null can't seek or be truncated
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    return write_all(fd, data, data_len);
+  }
+
+  long page_size = sysconf(_SC_PAGESIZE);
+  size_t page_len = (page_size > 0) ? (size_t)page_size : 4096;
+
+  // Walk the data a page at a time, writing each stretch of nonzero pages
+  // with a single write and seeking over each stretch of zero pages
+  size_t offset = 0;
+  while (offset < data_len)
+  {
+    size_t start = offset;
+    bool zero = false;
+    while (offset < data_len)
+    {
+      size_t len = data_len - offset;
+      if (len > page_len)
+      {
+        len = page_len;
+      }
+      bool page_zero = is_zero(&(data[offset]), len);
+      if (offset != start && page_zero != zero)
+      {
+        break;
+      }
+      zero = page_zero;
+      offset += len;
+    }
+
+    if (zero)
+    {
+      if (lseek(fd, offset - start, SEEK_CUR) < 0)
+      {
+        return false;
+      }
+    }
+    else if (!write_all(fd, &(data[start]), offset - start))
+    {
+      return false;
+    }
+  }
+
+  return ftruncate(fd, data_len) == 0;
+}
+
+bool map_output_file(const char* filename, size_t len, uint8_t** data)
+{
+  int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+  {
+    return false;
+  }
+  // The mapping stays valid after the descriptor is closed
+  *data = NULL;
+  if (len > 0)
+  {
+    // Reserve the blocks now, since running out of space while writing
+    // through the mapping would raise SIGBUS instead of returning an error
+    if (posix_fallocate(fd, 0, len) != 0)
+    {
+      close(fd);
+      return false;
+    }
+
+    void* mapping = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+      close(fd);
+      return false;
+    }
+    *data = mapping;
+  }
+  close(fd);
+  return true;
+}
+
+bool unmap_output_file(uint8_t* data, size_t len)
+{
+  if (len == 0)
+  {
+    return true;
+  }
+  return munmap(data, len) == 0;
+}
+
 uint16_t calculate_checksum(uint8_t* input_data, size_t input_len) {
 
 
@@ -164,6 +343,126 @@ uint16_t calculate_checksum(uint8_t* input_data, size_t input_len) {
 }
 
 
+// CRC32C (Castagnoli) lookup table for the reflected polynomial 0x82F63B78
+static const uint32_t crc32c_table[256] = {
+  0x00000000, 0xF26B8303, 0xE13B70F7, 0x1350F3F4,
+  0xC79A971F, 0x35F1141C, 0x26A1E7E8, 0xD4CA64EB,
+  0x8AD958CF, 0x78B2DBCC, 0x6BE22838, 0x9989AB3B,
+  0x4D43CFD0, 0xBF284CD3, 0xAC78BF27, 0x5E133C24,
+  0x105EC76F, 0xE235446C, 0xF165B798, 0x030E349B,
+  0xD7C45070, 0x25AFD373, 0x36FF2087, 0xC494A384,
+  0x9A879FA0, 0x68EC1CA3, 0x7BBCEF57, 0x89D76C54,
+  0x5D1D08BF, 0xAF768BBC, 0xBC267848, 0x4E4DFB4B,
+  0x20BD8EDE, 0xD2D60DDD, 0xC186FE29, 0x33ED7D2A,
+  0xE72719C1, 0x154C9AC2, 0x061C6936, 0xF477EA35,
+  0xAA64D611, 0x580F5512, 0x4B5FA6E6, 0xB93425E5,
+  0x6DFE410E, 0x9F95C20D, 0x8CC531F9, 0x7EAEB2FA,
+  0x30E349B1, 0xC288CAB2, 0xD1D83946, 0x23B3BA45,
+  0xF779DEAE, 0x05125DAD, 0x1642AE59, 0xE4292D5A,
+  0xBA3A117E, 0x4851927D, 0x5B016189, 0xA96AE28A,
+  0x7DA08661, 0x8FCB0562, 0x9C9BF696, 0x6EF07595,
+  0x417B1DBC, 0xB3109EBF, 0xA0406D4B, 0x522BEE48,
+  0x86E18AA3, 0x748A09A0, 0x67DAFA54, 0x95B17957,
+  0xCBA24573, 0x39C9C670, 0x2A993584, 0xD8F2B687,
+  0x0C38D26C, 0xFE53516F, 0xED03A29B, 0x1F682198,
+  0x5125DAD3, 0xA34E59D0, 0xB01EAA24, 0x42752927,
+  0x96BF4DCC, 0x64D4CECF, 0x77843D3B, 0x85EFBE38,
+  0xDBFC821C, 0x2997011F, 0x3AC7F2EB, 0xC8AC71E8,
+  0x1C661503, 0xEE0D9600, 0xFD5D65F4, 0x0F36E6F7,
+  0x61C69362, 0x93AD1061, 0x80FDE395, 0x72966096,
+  0xA65C047D, 0x5437877E, 0x4767748A, 0xB50CF789,
+  0xEB1FCBAD, 0x197448AE, 0x0A24BB5A, 0xF84F3859,
+  0x2C855CB2, 0xDEEEDFB1, 0xCDBE2C45, 0x3FD5AF46,
+  0x7198540D, 0x83F3D70E, 0x90A324FA, 0x62C8A7F9,
+  0xB602C312, 0x44694011, 0x5739B3E5, 0xA55230E6,
+  0xFB410CC2, 0x092A8FC1, 0x1A7A7C35, 0xE811FF36,
+  0x3CDB9BDD, 0xCEB018DE, 0xDDE0EB2A, 0x2F8B6829,
+  0x82F63B78, 0x709DB87B, 0x63CD4B8F, 0x91A6C88C,
+  0x456CAC67, 0xB7072F64, 0xA457DC90, 0x563C5F93,
+  0x082F63B7, 0xFA44E0B4, 0xE9141340, 0x1B7F9043,
+  0xCFB5F4A8, 0x3DDE77AB, 0x2E8E845F, 0xDCE5075C,
+  0x92A8FC17, 0x60C37F14, 0x73938CE0, 0x81F80FE3,
+  0x55326B08, 0xA759E80B, 0xB4091BFF, 0x466298FC,
+  0x1871A4D8, 0xEA1A27DB, 0xF94AD42F, 0x0B21572C,
+  0xDFEB33C7, 0x2D80B0C4, 0x3ED04330, 0xCCBBC033,
+  0xA24BB5A6, 0x502036A5, 0x4370C551, 0xB11B4652,
+  0x65D122B9, 0x97BAA1BA, 0x84EA524E, 0x7681D14D,
+  0x2892ED69, 0xDAF96E6A, 0xC9A99D9E, 0x3BC21E9D,
+  0xEF087A76, 0x1D63F975, 0x0E330A81, 0xFC588982,
+  0xB21572C9, 0x407EF1CA, 0x532E023E, 0xA145813D,
+  0x758FE5D6, 0x87E466D5, 0x94B49521, 0x66DF1622,
+  0x38CC2A06, 0xCAA7A905, 0xD9F75AF1, 0x2B9CD9F2,
+  0xFF56BD19, 0x0D3D3E1A, 0x1E6DCDEE, 0xEC064EED,
+  0xC38D26C4, 0x31E6A5C7, 0x22B65633, 0xD0DDD530,
+  0x0417B1DB, 0xF67C32D8, 0xE52CC12C, 0x1747422F,
+  0x49547E0B, 0xBB3FFD08, 0xA86F0EFC, 0x5A048DFF,
+  0x8ECEE914, 0x7CA56A17, 0x6FF599E3, 0x9D9E1AE0,
+  0xD3D3E1AB, 0x21B862A8, 0x32E8915C, 0xC083125F,
+  0x144976B4, 0xE622F5B7, 0xF5720643, 0x07198540,
+  0x590AB964, 0xAB613A67, 0xB831C993, 0x4A5A4A90,
+  0x9E902E7B, 0x6CFBAD78, 0x7FAB5E8C, 0x8DC0DD8F,
+  0xE330A81A, 0x115B2B19, 0x020BD8ED, 0xF0605BEE,
+  0x24AA3F05, 0xD6C1BC06, 0xC5914FF2, 0x37FACCF1,
+  0x69E9F0D5, 0x9B8273D6, 0x88D28022, 0x7AB90321,
+  0xAE7367CA, 0x5C18E4C9, 0x4F48173D, 0xBD23943E,
+  0xF36E6F75, 0x0105EC76, 0x12551F82, 0xE03E9C81,
+  0x34F4F86A, 0xC69F7B69, 0xD5CF889D, 0x27A40B9E,
+  0x79B737BA, 0x8BDCB4B9, 0x988C474D, 0x6AE7C44E,
+  0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351,
+};
+
+// Portable CRC32C update, one table lookup per byte
+static uint32_t crc32c_update_table(uint32_t crc, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc = crc32c_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+
+// CRC32C update using the SSE4.2 crc32 instruction, eight bytes at a time
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_update_sse42(uint32_t crc, const uint8_t* data, size_t len) {
+  uint64_t crc64 = crc;
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+    data += 8;
+    len -= 8;
+  }
+  crc = (uint32_t)crc64;
+  while (len > 0) {
+    crc = _mm_crc32_u8(crc, *data);
+    data++;
+    len--;
+  }
+  return crc;
+}
+
+static uint32_t crc32c_update(uint32_t crc, const uint8_t* data, size_t len) {
+  if (__builtin_cpu_supports("sse4.2")) {
+    return crc32c_update_sse42(crc, data, len);
+  }
+  return crc32c_update_table(crc, data, len);
+}
+#else
+static uint32_t crc32c_update(uint32_t crc, const uint8_t* data, size_t len) {
+  return crc32c_update_table(crc, data, len);
+}
+#endif
+
+uint32_t calculate_crc32c(uint8_t* input_data, size_t input_len) {
+  return ~crc32c_update(0xFFFFFFFF, input_data, input_len);
+}
+
+uint32_t extend_crc32c(uint32_t crc32c_value, uint8_t* input_data, size_t input_len) {
+  return ~crc32c_update(~crc32c_value, input_data, input_len);
+}
+
+
 uint16_t lfsr_step(uint16_t oldstate) {
 
 
@@ -201,6 +500,17 @@ uint16_t lfsr_step(uint16_t oldstate) {
 }
 
 
+void lfsr_keystream(uint16_t* state, uint8_t* keystream, size_t len) {
+  uint16_t current = *state;
+  for (size_t i = 0; i + 1 < len; i += 2) {
+    keystream[i] = current & 0x00FF;
+    keystream[i + 1] = (current & 0xFF00) >> 8;
+    current = lfsr_step(current);
+  }
+  *state = current;
+}
+
+
 void decrypt_data(uint8_t* input_data, size_t input_len,
                   uint8_t* output_data, size_t output_len,
                   uint16_t encryption_key) {
@@ -252,6 +562,34 @@ void decrypt_data(uint8_t* input_data, size_t input_len,
 
 
 
+size_t decompressed_length(uint8_t *input_data, size_t input_len)
+{
+  // Mirrors the token handling in decompress_data() without writing anything
+  size_t len = 0;
+  for (size_t i = 0; i < input_len; i++)
+  {
+    if (input_data[i] != ESCAPE_BYTE)
+    {
+      len++;
+    }
+    else if (i == (input_len - 1))
+    {
+      // a lone escape byte at the very end produces no output
+    }
+    else if (input_data[i + 1] == 0)
+    {
+      len++;
+      i++;
+    }
+    else
+    {
+      len += input_data[i + 1] >> 4;
+      i++;
+    }
+  }
+  return len;
+}
+
 size_t decompress_data(uint8_t *input_data, size_t input_len,
                        uint8_t *output_data, size_t output_len,
                        uint8_t *dictionary_data)
@@ -326,4 +664,38 @@ size_t decompress_data(uint8_t *input_data, size_t input_len,
   }
 
   return j;
-}
\ No newline at end of file
+}
+
+
+uint32_t decrypt_data_crc32c(uint8_t* input_data, size_t input_len,
+                             uint8_t* output_data, size_t output_len,
+                             uint16_t encryption_key) {
+
+  // Work through the input in small blocks so each block is checksummed and
+  // decrypted while it is still in cache, rather than making two full passes
+  // Blocks are an even number of bytes so the LFSR steps line up across blocks
+  const size_t block_len = 4096;
+  size_t decrypt_len = (input_len < output_len) ? input_len : output_len;
+
+  uint32_t crc = 0xFFFFFFFF;
+  uint16_t state = lfsr_step(encryption_key);
+
+  for (size_t start = 0; start < input_len; start += block_len) {
+    size_t len = input_len - start;
+    if (len > block_len) {
+      len = block_len;
+    }
+    crc = crc32c_update(crc, &(input_data[start]), len);
+
+    for (size_t i = start; i < start + len && i < decrypt_len; i += 2) {
+      output_data[i] = input_data[i] ^ (state & 0x00FF);
+      if (i + 1 == decrypt_len) {
+        break;
+      }
+      output_data[i + 1] = input_data[i + 1] ^ ((state & 0xFF00) >> 8);
+      state = lfsr_step(state);
+    }
+  }
+
+  return ~crc;
+}
@@ -12,6 +12,13 @@
 #define ESCAPE_BYTE 0x07
 #define MAX_RUN_LENGTH 16
 
+// Flag bit (below the compressed/encrypted/checksummed bits) selecting a
+// 32-bit CRC32C checksum instead of the 16-bit additive checksum
+#define CRC32C_FLAG 0x10
+
+// Longest possible header: magic, version, flags, dictionary, CRC32C
+#define MAX_HEADER_LENGTH (4 + DICTIONARY_LENGTH + 4)
+
 // Struct to hold header configuration data
 // The data is parsed from the header and recorded in this struct
 typedef struct {
@@ -38,6 +45,14 @@ typedef struct {
   // expected checksum value from header
   // (only valid if is_checksummed is true)
   uint16_t checksum_value;
+
+  // whether the checksum is a 32-bit CRC32C rather than the 16-bit sum
+  // (only valid if is_checksummed is true)
+  bool is_crc32c;
+
+  // expected CRC32C value from header
+  // (only valid if is_checksummed and is_crc32c are true)
+  uint32_t crc32c_value;
 } packlab_config_t;
 
 
@@ -53,6 +68,44 @@ void* malloc_and_check(size_t size);
 // Any unnecessary fields in config are left untouched
 void parse_header(uint8_t* input_data, size_t input_len, packlab_config_t* config);
 
+// Reads and parses only the header of the packed file at `filename`
+// At most MAX_HEADER_LENGTH bytes are read, no matter how large the file is
+// payload_len is set to the number of bytes following the header
+// Returns false if the file could not be opened or read, or is not a regular
+// file (config is untouched)
+bool read_pack_header(const char* filename, packlab_config_t* config, size_t* payload_len);
+
+// Reads exactly `len` bytes from `fd`, retrying short reads
+// Returns false on error or if the end of the file is reached first
+bool read_all(int fd, void* data, size_t len);
+
+// Writes all `len` bytes of data to `fd`, retrying short writes
+// Returns false if writing fails
+bool write_all(int fd, const void* data, size_t len);
+
+// Writes data to the start of the (empty) file `fd`
+// Page-aligned pages that are entirely zero are skipped with lseek instead of
+// written, leaving holes that read back as zeros
+// The file is extended to data_len at the end, so trailing zero pages are holes too
+// Anything other than a regular file (a pipe, /dev/null) is written normally
+// Returns false if writing fails
+bool write_sparse(int fd, const uint8_t* data, size_t data_len);
+
+// Creates the file `filename` with a length of exactly `len` bytes and maps
+// it into memory for writing, so output can be produced directly in the file
+// Disk space for all len bytes is allocated up front
+// *data is set to the mapping, or NULL if len is zero
+// Returns false if the file could not be created, allocated, or mapped
+bool map_output_file(const char* filename, size_t len, uint8_t** data);
+
+// Unmaps a file mapped with map_output_file()
+// Returns false if the mapping could not be removed
+bool unmap_output_file(uint8_t* data, size_t len);
+
+// Returns the exact number of bytes decompress_data() will produce from
+// input data, given unlimited output space
+size_t decompressed_length(uint8_t* input_data, size_t input_len);
+
 // Decompresses input data, creating output data
 // Returns the length of valid data inside the output data (<=output_len)
 // Expects a previously calculated compression dictionary
@@ -66,6 +119,12 @@ size_t decompress_data(uint8_t* input_data, size_t input_len,
 // Does not save state internally. To iterate, update as oldstate = lfsr_step(oldstate)
 uint16_t lfsr_step(uint16_t oldstate);
 
+// Writes `len` bytes of the decryption keystream, in the byte order that
+// decrypt_data() applies them, starting from LFSR state *state
+// `len` must be even; *state is advanced past the bytes written
+// XORing data with the keystream from lfsr_step(encryption_key) decrypts it
+void lfsr_keystream(uint16_t* state, uint8_t* keystream, size_t len);
+
 // Decrypts input data, creating output data
 // Writes decrypted data directly into `output_data`
 void decrypt_data(uint8_t* input_data, size_t input_len,
@@ -75,3 +134,22 @@ void decrypt_data(uint8_t* input_data, size_t input_len,
 // Calculates a 16-bit checksum value over input data
 uint16_t calculate_checksum(uint8_t* input_data, size_t input_len);
 
+// Calculates a 32-bit CRC32C (Castagnoli) value over input data
+// Uses the SSE4.2 crc32 instruction when the CPU supports it, and a
+// table-driven implementation otherwise
+uint32_t calculate_crc32c(uint8_t* input_data, size_t input_len);
+
+// Continues a CRC32C value of earlier data over input data, so that
+// extend_crc32c(calculate_crc32c(a), b) is the CRC32C of a followed by b
+// extend_crc32c(0, data, len) equals calculate_crc32c(data, len)
+uint32_t extend_crc32c(uint32_t crc32c_value, uint8_t* input_data, size_t input_len);
+
+// Decrypts input data exactly like decrypt_data(), while also calculating
+// the CRC32C of the (encrypted) input data in the same pass
+// Only useful when the key is known before the checksum has to be checked,
+// as in the daemon; unpack checks first so it never prompts for a password
+// for a corrupt pack
+// Returns the CRC32C value of all input_len bytes of input_data
+uint32_t decrypt_data_crc32c(uint8_t* input_data, size_t input_len,
+                             uint8_t* output_data, size_t output_len,
+                             uint16_t encryption_key);
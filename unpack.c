@@ -1,25 +1,60 @@
 // Application to unpack files
 // PackLab - CS213 - Northwestern University
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include "unpack-cache.h"
+#include "unpack-list.h"
 #include "unpack-utilities.h"
 
 
+// Creates and maps an output file of exactly `len` bytes for --mmap
+// Exits with the usual error if the file can't be created or its space
+// can't be reserved (for example, the disk is full)
+static uint8_t* map_output_or_exit(const char* filename, size_t len) {
+  uint8_t* data = NULL;
+  if (!map_output_file(filename, len, &data)) {
+    error_and_exit("ERROR: could not write output file data\n");
+  }
+  return data;
+}
+
+
 int main(int argc, char* argv[]) {
   // Parse app flags
-  // No flags for unpack, just input and output filenames
-  if (argc != 3) {
-    printf("usage: %s inputfilename outputfilename\n", argv[0]);
+  // `--list` prints headers of packed files (or directories of them) only
+  if (argc >= 3 && strcmp(argv[1], "--list") == 0) {
+    // Header reads are mostly waiting on storage, so use more threads than CPUs
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = 4 * ((cpu_count > 0) ? (size_t)cpu_count : 1);
+    size_t failures = list_packs(&(argv[2]), argc - 2, thread_count);
+    return (failures == 0) ? 0 : 1;
+  }
+
+  // Otherwise input and output filenames, optionally preceded by `--mmap` to
+  // decode directly into a memory-mapped output file
+  bool use_mmap = false;
+  int first_filename = 1;
+  if (argc >= 2 && strcmp(argv[1], "--mmap") == 0) {
+    use_mmap = true;
+    first_filename = 2;
+  }
+  if (argc - first_filename != 2) {
+    printf("usage: %s [--mmap] inputfilename outputfilename\n", argv[0]);
+    printf("       %s --list packpath...\n", argv[0]);
     error_and_exit("\n");
   }
-  char* input_filename = argv[1];
-  char* output_filename = argv[2];
+  char* input_filename = argv[first_filename];
+  char* output_filename = argv[first_filename + 1];
 
   // Validate input data
   if (strcmp(input_filename, output_filename) == 0) {
@@ -68,11 +103,23 @@ int main(int argc, char* argv[]) {
   uint8_t* data = malloc_and_check(data_len);
   memcpy(data, &(input_data[config.header_len]), data_len);
 
+  // Keep the header bytes, they are part of the cache key
+  uint8_t header[MAX_HEADER_LENGTH];
+  memcpy(header, input_data, config.header_len);
+
   // Done with the raw input data
   free(input_data);
 
   // Handle checksumming
-  if (config.is_checksummed) {
+  // Every checksum is validated here, before the password prompt, so a
+  // corrupt pack is rejected without asking for a password
+  if (config.is_checksummed && config.is_crc32c) {
+
+    // Calculate and validate CRC32C of data
+    if (calculate_crc32c(data, data_len) != config.crc32c_value) {
+      error_and_exit("ERROR: checksum is invalid\n");
+    }
+  } else if (config.is_checksummed && !config.is_crc32c) {
 
     // Calculate checksum of data
     uint16_t calc_checksum = calculate_checksum(data, data_len);
@@ -85,9 +132,10 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  // Handle decryption
+  // Get a password from the user
+  // This happens before decryption since the key is also part of the cache key
+  uint16_t encryption_key = 0;
   if (config.is_encrypted) {
-    // Get a password from the user
     char password[80];
     printf("Type the file password and hit enter: ");
     int match_count = scanf("%79s", password);
@@ -97,45 +145,122 @@ int main(int argc, char* argv[]) {
 
     // Use a checksum as a lazy method for "hashing" the password
     // This isn't ideal as it will have many collisions (password "ab" equals password "ba")
-    uint16_t encryption_key = calculate_checksum((uint8_t*)password, strlen(password));
+    encryption_key = calculate_checksum((uint8_t*)password, strlen(password));
+  }
+
+  // Handle caching
+  // When PACKLAB_CACHE_DIR is set, output of a byte-identical pack (and
+  // password) that was unpacked before is copied instead of decoded again
+  // Small packs decode faster than the cache can be checked, so they skip it
+  const char* cache_dir = getenv("PACKLAB_CACHE_DIR");
+  if (data_len < CACHE_MIN_BYTES) {
+    cache_dir = NULL;
+  }
+  uint64_t cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+  char key[CACHE_KEY_LENGTH];
+  if (cache_dir != NULL) {
+    const char* max_bytes = getenv("PACKLAB_CACHE_MAX_BYTES");
+    if (max_bytes != NULL) {
+      cache_max_bytes = strtoull(max_bytes, NULL, 0);
+    }
+    cache_key(header, config.header_len, data, data_len,
+              config.is_encrypted, encryption_key, key);
+    if (cache_fetch(cache_dir, key, output_filename)) {
+      free(data);
+      return 0;
+    }
+  }
 
+  // Whether data currently points into a memory-mapped output file
+  bool data_is_mapped = false;
+
+  // Handle decryption
+  if (config.is_encrypted) {
     // Decrypt the data
+    // If this is the last stage of a memory-mapped unpack, decrypt straight
+    // into the output file
+    bool decrypt_to_file = use_mmap && !config.is_compressed;
     size_t output_len = data_len;
-    uint8_t* output_data = malloc_and_check(output_len);
+    uint8_t* output_data = NULL;
+    if (decrypt_to_file) {
+      output_data = map_output_or_exit(output_filename, output_len);
+    } else {
+      output_data = malloc_and_check(output_len);
+    }
     decrypt_data(data, data_len, output_data, output_len, encryption_key);
 
     // Replace data with new output
     free(data);
     data = output_data;
     data_len = output_len;
+    data_is_mapped = decrypt_to_file;
   }
 
   // Handle decompression
   if (config.is_compressed) {
     // Decompress the data
-    size_t output_len = (MAX_RUN_LENGTH*input_len)/2; // worst-case output could be MAX_RUN_LENGTH bytes for every two bytes
-    uint8_t* output_data = malloc_and_check(output_len);
+    // A memory-mapped output file is sized exactly, otherwise use a worst-case buffer
+    size_t output_len = 0;
+    uint8_t* output_data = NULL;
+    if (use_mmap) {
+      output_len = decompressed_length(data, data_len);
+      output_data = map_output_or_exit(output_filename, output_len);
+    } else {
+      output_len = (MAX_RUN_LENGTH*input_len)/2; // worst-case output could be MAX_RUN_LENGTH bytes for every two bytes
+      output_data = malloc_and_check(output_len);
+    }
     output_len = decompress_data(data, data_len, output_data, output_len, config.dictionary_data);
 
     // Replace data with new output
     free(data);
     data = output_data;
     data_len = output_len;
+    data_is_mapped = use_mmap;
+  }
+
+  if (use_mmap) {
+    // Neither stage ran, so the payload itself is copied into the output file
+    if (!data_is_mapped) {
+      uint8_t* output_data = map_output_or_exit(output_filename, data_len);
+      if (data_len > 0) {
+        memcpy(output_data, data, data_len);
+      }
+      free(data);
+      data = output_data;
+    }
+
+    // The output's space was reserved up front, so the mapping now holds
+    // all of it and can be stored before it is unmapped
+    if (cache_dir != NULL) {
+      cache_store(cache_dir, key, data, data_len, cache_max_bytes);
+    }
+
+    // Output was produced in place, so unmapping is all that's left
+    if (!unmap_output_file(data, data_len)) {
+      error_and_exit("ERROR: could not write output file data\n");
+    }
+    return 0;
   }
 
   // Create output file
   // This is done late in the process in case the input was invalid
-  FILE* output_fd = fopen(output_filename, "w");
-  if (output_fd == NULL) {
+  int output_fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (output_fd < 0) {
     error_and_exit("ERROR: could not open output file\n");
   }
 
   // Write data to output file
-  size_t write_len = fwrite(data, sizeof(uint8_t), data_len, output_fd);
-  if (write_len != data_len) {
+  // Zero pages (common in long decompressed runs) are left as holes
+  if (!write_sparse(output_fd, data, data_len)) {
     error_and_exit("ERROR: could not write output file data\n");
   }
-  fclose(output_fd);
+  close(output_fd);
+
+  // Remember the output for the next unpack of the same pack
+  // Stored from the decoded data, since the output may be a pipe or device
+  if (cache_dir != NULL) {
+    cache_store(cache_dir, key, data, data_len, cache_max_bytes);
+  }
   free(data);
 
   return 0;